@@ -37,12 +37,6 @@ namespace Assembler
     enum ReservedWords {CallTable=0, StartAddress, SingleStepWatch, DisableUpload, CpuUsageAddressA, CpuUsageAddressB, INCLUDE, MACRO, ENDM, GPRINTF, NumReservedWords};
 
 
-    struct Label
-    {
-        uint16_t _address;
-        std::string _name;
-    };
-
     struct Equate
     {
         bool _isCustomAddress;
@@ -91,7 +85,6 @@ namespace Assembler
             std::string _var;
         };
 
-        bool _displayed = false;
         uint16_t _address;
         int _lineNumber;
         std::string _lineToken;
@@ -110,7 +103,7 @@ namespace Assembler
     uint16_t _currDasmByteCount = 1, _prevDasmByteCount = 1;
     uint16_t _currDasmPageByteCount = 0, _prevDasmPageByteCount = 0;
 
-    std::string _includePath = ".";
+    thread_local std::string _includePath = ".";
 
     std::vector<Label> _labels;
     std::vector<Equate> _equates;
@@ -128,12 +121,14 @@ namespace Assembler
 
     const std::string& getIncludePath(void) {return _includePath;}
     uint16_t getStartAddress(void) {return _startAddress;}
+    int getLabelsSize(void) {return int(_labels.size());}
     int getPrevDasmByteCount(void) {return _prevDasmByteCount;}
     int getCurrDasmByteCount(void) {return _currDasmByteCount;}
     int getPrevDasmPageByteCount(void) {return _prevDasmPageByteCount;}
     int getCurrDasmPageByteCount(void) {return _currDasmPageByteCount;}
     int getDisassembledCodeSize(void) {return int(_disassembledCode.size());}
     DasmCode* getDisassembledCode(int index) {return &_disassembledCode[index % _disassembledCode.size()];}
+    Label* getLabel(int index) {return &_labels[index % _labels.size()];}
 
     void setIncludePath(const std::string& includePath) {_includePath = includePath;}
 
@@ -511,13 +506,13 @@ namespace Assembler
                     {
                         sprintf(dasmText, "%04x  $%02x $%02x", address, instruction, data0);
                         dasmCode._address = address;
-                        address = (address + 1) & (Memory::getSizeRAM() - 1);
+                        address = (address + 1) & (Cpu::getSizeRAM() - 1);
                         break;
                     }
 
                     sprintf(dasmText, "%04x  %s", address, mnemonic);
                     dasmCode._address = address;
-                    address = (address + 1) & (Memory::getSizeRAM() - 1);
+                    address = (address + 1) & (Cpu::getSizeRAM() - 1);
                 }
                 break;
 
@@ -535,7 +530,7 @@ namespace Assembler
                     {
                         sprintf(dasmText, "%04x  $%02x", address, instruction);
                         dasmCode._address = address;
-                        address = (address + 1) & (Memory::getSizeRAM() - 1);
+                        address = (address + 1) & (Cpu::getSizeRAM() - 1);
                         break;
                     }
 
@@ -548,7 +543,7 @@ namespace Assembler
                         {
                             sprintf(dasmText, "%04x  $%02x", address, instruction);
                             dasmCode._address = address;
-                            address = (address + 1) & (Memory::getSizeRAM() - 1);
+                            address = (address + 1) & (Cpu::getSizeRAM() - 1);
                             break;
                         }
                         foundBranch = true;
@@ -564,7 +559,7 @@ namespace Assembler
                         default: break;
                     }
                     dasmCode._address = address;
-                    address = uint16_t((address + byteSize) & (Memory::getSizeRAM() - 1));
+                    address = uint16_t((address + byteSize) & (Cpu::getSizeRAM() - 1));
 
                     // Save current and previous instruction sizes to allow scrolling
                     getDasmCurrAndPrevByteSize(dasmCode._address, byteSize);
@@ -1971,8 +1966,11 @@ namespace Assembler
                         std::vector<std::string> variables = Expression::tokenise(variableText, ',');
                         parseGprintfFormat(formatText, variables, vars, subs);
 
-                        Gprintf gprintf = {false, _currentAddress, lineNumber, lineToken, formatText, vars, subs};
+                        Gprintf gprintf = {_currentAddress, lineNumber, lineToken, formatText, vars, subs};
                         _gprintfs.push_back(gprintf);
+#ifndef STAND_ALONE
+                        Editor::addGprintfTrap(_currentAddress);
+#endif
                     }
 
                     return true;
@@ -2116,26 +2114,16 @@ namespace Assembler
         return true;
     }
 
-    void printGprintfStrings(void)
+    // Called by the debugger when vPC arrives at a gprintf address, so each gprintf is displayed once per visit
+    void printGprintfStrings(uint16_t address)
     {
-        if(_gprintfs.size() == 0) return;
-
         for(int i=0; i<int(_gprintfs.size()); i++)
         {
-            if(Cpu::getVPC() == _gprintfs[i]._address)
-            {
-                // Emulator can cycle many times for one CPU cycle, so make sure gprintf is displayed only once
-                if(!_gprintfs[i]._displayed)
-                {
-                    std::string gstring;
-                    getGprintfString(i, gstring);
-                    fprintf(stderr, "gprintf() : address $%04X : '%s'\n", _gprintfs[i]._address, gstring.c_str());
-                    _gprintfs[i]._displayed = true;
-                }
-            }
-            else
+            if(_gprintfs[i]._address == address)
             {
-                _gprintfs[i]._displayed = false;
+                std::string gstring;
+                getGprintfString(i, gstring);
+                fprintf(stderr, "gprintf() : address $%04X : '%s'\n", _gprintfs[i]._address, gstring.c_str());
             }
         }
     }
@@ -2173,6 +2161,7 @@ namespace Assembler
 
 #ifndef STAND_ALONE
         Editor::clearVpcBreakPoints();
+        Editor::clearGprintfTraps();
 #endif
     }
 
@@ -87,6 +87,12 @@ namespace Assembler
         std::string _mnemonic;
     };
 
+    struct Label
+    {
+        uint16_t _address;
+        std::string _name;
+    };
+
     struct LineToken
     {
         bool _fromInclude = false;
@@ -98,6 +104,8 @@ namespace Assembler
 
     const std::string& getIncludePath(void);
     uint16_t getStartAddress(void);
+    int getLabelsSize(void);
+    Label* getLabel(int index);
     int getCurrDasmByteCount(void);
     int getPrevDasmByteCount(void);
     int getPrevDasmPageByteCount(void);
@@ -119,7 +127,7 @@ namespace Assembler
     int disassemble(uint16_t address);
 
 #ifndef STAND_ALONE
-    void printGprintfStrings(void);
+    void printGprintfStrings(uint16_t address);
 #endif
 }
 
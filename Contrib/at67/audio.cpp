@@ -1,8 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <algorithm>
 #include <atomic>
+#include <vector>
+#include <fstream>
 
 #include "memory.h"
 #include "loader.h"
@@ -10,36 +13,114 @@
 #include "audio.h"
 #include "timing.h"
 #include "editor.h"
+#include "capture.h"
 #include "expression.h"
 #include "inih/INIReader.h"
 #include "tools/gtmidi/music.h"
 
+#ifndef HEADLESS
 #include <SDL.h>
+#endif
 
 
-#define AUDIO_SAMPLES     (SCAN_LINES)
-#define AUDIO_BUFFER_SIZE (SCAN_LINES*4)
-#define AUDIO_FREQUENCY   (int(SCAN_LINES*59.98))
+#define AUDIO_SAMPLES        (SCAN_LINES)
+#define AUDIO_SOURCE_RATE    (double(CLOCK_FREQ) / double(HLINE_END)) // one sample per scanline
+#define AUDIO_DEVICE_RATE    48000 // asked for, whatever rate the device actually runs at is used
+#define AUDIO_DEVICE_SAMPLES 512
+#define AUDIO_RING_SIZE      32768 // over 3 times the longest latency
+#define AUDIO_TAPS           16
+#define AUDIO_PHASES         128
+#define AUDIO_CUTOFF         0.9   // fraction of the source's nyquist
+#define AUDIO_LATENCY_MS     40
+#define AUDIO_FILL_SMOOTHING 0.02  // per device callback
+#define AUDIO_RATE_GAIN      0.02
+#define AUDIO_RATE_INTEGRAL  0.0001
+#define AUDIO_MAX_ADJUST     0.02  // +/- 2% of pitch at most
+#define AUDIO_RENDER_RATE    44100
+#define AUDIO_RENDER_SCALE   4096.0 // 4 bit samples centred on 7.5, (+/-30720)
+#define AUDIO_DC_BLOCKER     0.9995 // ~3.5Hz high pass, the real board's output is AC coupled
 
 
 namespace Audio
 {
     bool _realTimeAudio = true;
 
+#ifndef HEADLESS
     SDL_AudioDeviceID _audioDevice = 1;
+#endif
 
-    std::atomic<int64_t> _audioInIndex(AUDIO_SAMPLES*2);
-    std::atomic<int64_t> _audioOutIndex(0);
-    uint16_t _audioSamples[AUDIO_BUFFER_SIZE] = {0};
+    // Single producer, (hSync on the emulation thread), single consumer, (the device callback), the indices only ever increase
+    int16_t _ring[AUDIO_RING_SIZE];
+    std::atomic<uint64_t> _ringHead(0);
+    std::atomic<uint64_t> _ringTail(0);
+    std::atomic<bool> _flush(false);
+
+    // Windowed sinc resampler from the scanline rate to the device's rate, one filter per fractional phase, (plus one so that adjacent
+    // phases can be interpolated); a rate controller nudges the step so that the ring's fill level sits at the latency target
+    float _filters[AUDIO_PHASES + 1][AUDIO_TAPS];
+    float _history[AUDIO_TAPS] = {0.0f};
+    int16_t _lastSample = 0;
+    double _phase = 0.0;
+    double _step = 1.0;
+    double _deviceRate = AUDIO_DEVICE_RATE;
+    double _targetFill = AUDIO_SOURCE_RATE * AUDIO_LATENCY_MS / 1000.0;
+    double _averageFill = 0.0;
+    double _rateDrift = 0.0;
+    bool _priming = true;
+
+    // Synthesis, the channels' oscillators, (low byte is oscL, high byte is oscH), and the ROM's sample accumulator state
+    bool _synthesis = false;
+    uint16_t _oscillators[GIGA_SOUND_CHANNELS] = {0};
+    uint8_t _channel = 0;
+    uint8_t _sample = 3;
+    uint8_t _xout = 0;
+
+    // Offline rendering, every scanline's 4 bit sample for the whole run
+    bool _rendering = false;
+    std::vector<uint8_t> _renderSamples;
+
+    // Queued audio
+    uint16_t _audioSamples[AUDIO_SAMPLES] = {0};
+    int _audioIndex = 0;
+
+    // gtMIDI scores are parsed once into events stamped with the frame they fire on, a segment command ends the score and it loops
+    struct Score
+    {
+        const uint8_t* _data;
+        int _size;
+    };
+
+    struct MidiEvent
+    {
+        uint32_t _frame;
+        uint8_t _command;
+        uint8_t _note;
+    };
 
     int _scoreIndex = 0;
-    uint8_t* _score[] = {(uint8_t*)musicMidi00};
-    uint8_t* _scorePtr = (uint8_t*)_score[_scoreIndex];
+    Score _scores[] = {{musicMidi00, int(sizeof(musicMidi00))}};
+    std::vector<MidiEvent> _midiEvents;
+    uint32_t _midiFrames = 1;
+    uint32_t _midiFrame = 0;
+    size_t _midiIndex = 0;
 
     INIReader _configIniReader;
 
 
     bool getRealTimeAudio(void) {return _realTimeAudio;}
+    bool getSynthesis(void) {return _synthesis;}
+
+    void setSynthesis(bool synthesis)
+    {
+        // Oscillators carry on from wherever the ROM's are
+        for(int i=0; i<GIGA_SOUND_CHANNELS; i++)
+        {
+            uint16_t channel = uint16_t(i*GIGA_CHANNEL_OFFSET);
+            _oscillators[i] = uint16_t(Cpu::getRAM(GIGA_CH0_OSC_L + channel) | (Cpu::getRAM(GIGA_CH0_OSC_H + channel) <<8));
+        }
+
+        _synthesis = synthesis;
+    }
 
     bool getKeyAsString(const std::string& sectionString, const std::string& iniKey, const std::string& defaultKey, std::string& result)
     {
@@ -49,24 +130,108 @@ namespace Audio
         return true;
     }
 
+    void createFilters(void)
+    {
+        const double pi = 3.14159265358979323846;
+        for(int p=0; p<=AUDIO_PHASES; p++)
+        {
+            double sum = 0.0;
+            double fraction = double(p) / double(AUDIO_PHASES);
+            for(int k=0; k<AUDIO_TAPS; k++)
+            {
+                // Distance in source samples from the output position, which lies between the two centre taps
+                double t = double(k - (AUDIO_TAPS/2 - 1)) - fraction;
+                double x = pi * AUDIO_CUTOFF * t;
+                double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(x) / x;
+                double w = 2.0 * pi * (t + AUDIO_TAPS/2) / double(AUDIO_TAPS);
+                double blackman = std::max(0.0, 0.42 - 0.5*cos(w) + 0.08*cos(2.0*w));
+
+                _filters[p][k] = float(sinc * blackman);
+                sum += sinc * blackman;
+            }
+
+            // Unity gain at DC for every phase
+            for(int k=0; k<AUDIO_TAPS; k++) _filters[p][k] = float(_filters[p][k] / sum);
+        }
+    }
+
+    // Band limited value at a fractional position between the two centre taps of the history
+    float filterSample(const float* history, double phase)
+    {
+        double position = phase * AUDIO_PHASES;
+        int p = int(position);
+        float blend = float(position - p);
+        float sample = 0.0f;
+        for(int k=0; k<AUDIO_TAPS; k++) sample += history[k] * (_filters[p][k] + (_filters[p + 1][k] - _filters[p][k])*blend);
+
+        return sample;
+    }
+
+#ifndef HEADLESS
+    // Next scanline sample from the ring, holds the last one when the ring runs dry and then waits for it to refill to the target
+    float nextSample(void)
+    {
+        uint64_t tail = _ringTail.load(std::memory_order_relaxed);
+        if(_priming  ||  tail == _ringHead.load(std::memory_order_acquire))
+        {
+            _priming = true;
+            return float(_lastSample);
+        }
+
+        _lastSample = _ring[tail % AUDIO_RING_SIZE];
+        _ringTail.store(tail + 1, std::memory_order_release);
+        return float(_lastSample);
+    }
+
     void sdl2AudioCallback(void* userData, unsigned char *stream, int length)
     {
         UNREFERENCED_PARAM(userData);
 
         int16_t *sdl2Stream = (int16_t *)stream;
 
+        uint64_t head = _ringHead.load(std::memory_order_acquire);
+        uint64_t tail = _ringTail.load(std::memory_order_relaxed);
+        if(_flush.exchange(false)) tail = head, _priming = true;
+
+        // Far too much buffered, (after a stall, or if the emulation outruns real time), skip back to the target
+        double fill = double(head - tail);
+        if(fill > std::max(_targetFill*3.0, _targetFill + SCAN_LINES*3))
+        {
+            tail = head - uint64_t(_targetFill);
+            fill = _targetFill;
+            _averageFill = _targetFill;
+        }
+        _ringTail.store(tail, std::memory_order_release);
+
+        if(_priming  &&  fill >= _targetFill)
+        {
+            _priming = false;
+            _averageFill = _targetFill;
+        }
+
+        // Proportional and integral control on the smoothed fill level, a fuller ring is drained a little faster, the integral learns the
+        // steady drift between the emulation's and the device's clocks
+        _averageFill += (fill - _averageFill) * AUDIO_FILL_SMOOTHING;
+        double error = (_averageFill - _targetFill) / _targetFill;
+        if(!_priming) _rateDrift = std::min(std::max(_rateDrift + error*AUDIO_RATE_INTEGRAL, -AUDIO_MAX_ADJUST), AUDIO_MAX_ADJUST);
+        double adjust = std::min(std::max(error*AUDIO_RATE_GAIN + _rateDrift, -AUDIO_MAX_ADJUST), AUDIO_MAX_ADJUST);
+        double step = _step * (1.0 + adjust);
+
         for(int i=0; i<length/2; i++)
         {
-            if(_audioOutIndex % AUDIO_BUFFER_SIZE  ==  _audioInIndex % AUDIO_BUFFER_SIZE)
+            while(_phase >= 1.0)
             {
-                sdl2Stream[i] = _audioSamples[(_audioOutIndex-1) % AUDIO_BUFFER_SIZE];
-            }
-            else
-            {
-                sdl2Stream[i] = _audioSamples[_audioOutIndex++ % AUDIO_BUFFER_SIZE];
+                _phase -= 1.0;
+                memmove(&_history[0], &_history[1], (AUDIO_TAPS - 1)*sizeof(float));
+                _history[AUDIO_TAPS - 1] = nextSample();
             }
+
+            float sample = filterSample(_history, _phase);
+            sdl2Stream[i] = int16_t(std::min(std::max(sample, -32768.0f), 32767.0f));
+            _phase += step;
         }
     }
+#endif
 
 
     void initialise(void)
@@ -95,6 +260,13 @@ namespace Audio
                     {
                         getKeyAsString(sectionString, "RealTimeAudio", "1", result);   
                         _realTimeAudio = strtol(result.c_str(), nullptr, 10);
+
+                        getKeyAsString(sectionString, "Synthesis", "0", result);
+                        setSynthesis(strtol(result.c_str(), nullptr, 10) != 0);
+
+                        getKeyAsString(sectionString, "Latency", std::to_string(AUDIO_LATENCY_MS), result);
+                        int latency = std::min(std::max(int(strtol(result.c_str(), nullptr, 10)), 10), 200);
+                        _targetFill = AUDIO_SOURCE_RATE * latency / 1000.0;
                     }
                     break;
                 }
@@ -105,29 +277,39 @@ namespace Audio
             fprintf(stderr, "Audio::initialise() : couldn't find audio configuration INI file '%s' : reverting to default values.\n", AUDIO_CONFIG_INI);
         }
 
-        SDL_AudioSpec audSpec;
+#ifndef HEADLESS
+        SDL_AudioSpec audSpec, haveSpec;
         SDL_zero(audSpec);
-        audSpec.freq = AUDIO_FREQUENCY;
-        audSpec.format = AUDIO_S16;
+        audSpec.freq = AUDIO_DEVICE_RATE;
+        audSpec.format = AUDIO_S16SYS;
         audSpec.channels = 1;
         audSpec.callback = sdl2AudioCallback;
-        audSpec.samples = AUDIO_SAMPLES;
+        audSpec.samples = AUDIO_DEVICE_SAMPLES;
 
-        if(SDL_OpenAudio(&audSpec, NULL) < 0)
+        // Runs at the device's native rate, the resampler makes up the difference
+        _audioDevice = SDL_OpenAudioDevice(NULL, 0, &audSpec, &haveSpec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+        if(_audioDevice == 0)
         {
             Cpu::shutdown();
             fprintf(stderr, "Audio::initialise() : failed to initialise SDL audio\n");
             _EXIT_(EXIT_FAILURE);
         }
 
+        _deviceRate = double(haveSpec.freq);
+        _step = AUDIO_SOURCE_RATE / _deviceRate;
+        createFilters();
+#endif
+
         initialiseChannels();
 
-        SDL_PauseAudio(0);
+#ifndef HEADLESS
+        SDL_PauseAudioDevice(_audioDevice, 0);
+#endif
     }
 
     void initialiseChannels(bool coldBoot)
     {
-        static uint8_t waveTables[256];
+        uint8_t* waveTables = Cpu::getEmulator()->_machine._waveTables;
 
         // Enable all 4 audio channels by default
         Cpu::setRAM(CHANNEL_MASK, uint8_t(Cpu::getRomType()) | 0x03);
@@ -173,107 +355,322 @@ namespace Audio
 
     void fillCallbackBuffer(void)
     {
-        _audioSamples[_audioInIndex++ % AUDIO_BUFFER_SIZE] = (Cpu::getXOUT() & 0xf0) <<5;
+        Capture::captureSample(Cpu::getXOUT());
+
+        if(_synthesis) return;
+
+#ifndef HEADLESS
+        // Turbo is muted, the callback holds the last sample whilst the ring is starved
+        if(Timing::getTurbo()) return;
+
+        // Overruns drop the newest samples, the callback catches up on the rest
+        uint64_t head = _ringHead.load(std::memory_order_relaxed);
+        if(head - _ringTail.load(std::memory_order_acquire) >= AUDIO_RING_SIZE) return;
+
+        _ring[head % AUDIO_RING_SIZE] = int16_t((Cpu::getXOUT() & 0xf0) <<5);
+        _ringHead.store(head + 1, std::memory_order_release);
+#else
+        if(_rendering) _renderSamples.push_back(Cpu::getXOUT() >>4);
+#endif
+    }
+
+    void synthesiseFrame(void)
+    {
+        if(!_synthesis) return;
+
+#ifndef HEADLESS
+        // Frames are skipped whole whilst the ring is more than 2 frames over the target, the oscillators only advance for frames that
+        // are heard, so there is no discontinuity
+        uint64_t head = _ringHead.load(std::memory_order_relaxed);
+        if(double(head - _ringTail.load(std::memory_order_acquire)) > _targetFill + SCAN_LINES*2) return;
+#else
+        if(!_rendering) return;
+#endif
+
+        // Only ROMv4 onwards can mask channels off
+        uint8_t channelMask = (Cpu::getRomType() >= Cpu::ROMv4) ? Cpu::getRAM(CHANNEL_MASK) & 0x03 : 0x03;
+        // The ROM's vBlank maintains xoutMask from the sound timer, (and the LEDs in the low nibble)
+        uint8_t xoutMask = Cpu::getRAM(GIGA_XOUT_MASK);
+
+        uint8_t keyL[GIGA_SOUND_CHANNELS], keyH[GIGA_SOUND_CHANNELS], wavA[GIGA_SOUND_CHANNELS], wavX[GIGA_SOUND_CHANNELS], soundTable[256];
+        for(int i=0; i<GIGA_SOUND_CHANNELS; i++)
+        {
+            uint16_t channel = uint16_t(i*GIGA_CHANNEL_OFFSET);
+            keyL[i] = Cpu::getRAM(GIGA_CH0_KEY_L + channel);
+            keyH[i] = Cpu::getRAM(GIGA_CH0_KEY_H + channel);
+            wavA[i] = Cpu::getRAM(GIGA_CH0_WAV_A + channel);
+            wavX[i] = Cpu::getRAM(GIGA_CH0_WAV_X + channel);
+        }
+        for(int i=0; i<256; i++) soundTable[i] = Cpu::getRAM(uint16_t(GIGA_SOUND_TABLE + i));
+
+        // One channel per scanline, (see 'sound1' in the ROM), the sample is emitted and reset to 3 once every 4 scanlines
+        for(int line=0; line<SCAN_LINES; line++)
+        {
+            _channel = (_channel & channelMask) + 1;
+            int i = _channel - 1;
+
+            uint8_t oscL = uint8_t((_oscillators[i] & 0x7F) + keyL[i]);
+            uint8_t oscH = uint8_t((_oscillators[i] >>8) + keyH[i] + (oscL >>7));
+            _oscillators[i] = uint16_t(oscL | (oscH <<8));
+
+            uint8_t value = uint8_t(wavA[i] + soundTable[(oscH & 0xFC) ^ wavX[i]]);
+            _sample = uint8_t(_sample + ((value & 0x80) ? 63 : (value & 63)));
+
+            if((line & 3) == 3)
+            {
+                _xout = (_sample | 0x0F) & xoutMask;
+                _sample = 3;
+            }
+
+#ifndef HEADLESS
+            _ring[(head + line) % AUDIO_RING_SIZE] = int16_t((_xout & 0xf0) <<5);
+#else
+            _renderSamples.push_back(_xout >>4);
+#endif
+        }
+
+#ifndef HEADLESS
+        _ringHead.store(head + SCAN_LINES, std::memory_order_release);
+#endif
     }
 
     void fillBuffer(void)
     {
-        _audioSamples[_audioInIndex++] = (Cpu::getXOUT() & 0xf0) <<5;
-        if(_audioInIndex == AUDIO_SAMPLES)
+        _audioSamples[_audioIndex++] = (Cpu::getXOUT() & 0xf0) <<5;
+        if(_audioIndex == AUDIO_SAMPLES)
         {
             playBuffer();
-            _audioInIndex = 0;
+            _audioIndex = 0;
         }
     }
 
     void playBuffer(void)
     {
-        SDL_QueueAudio(_audioDevice, &_audioSamples[0], uint32_t(_audioInIndex) <<1);
-        _audioInIndex = 0;
+#ifndef HEADLESS
+        SDL_QueueAudio(_audioDevice, &_audioSamples[0], uint32_t(_audioIndex) <<1);
+#endif
+        _audioIndex = 0;
     }
 
     void playSample(void)
     {
+#ifndef HEADLESS
         uint16_t sample = (Cpu::getXOUT() & 0xf0) <<5;
         SDL_QueueAudio(_audioDevice, &sample, 2);
+#endif
     }
 
     void clearQueue(void)
     {
+#ifndef HEADLESS
         SDL_ClearQueuedAudio(_audioDevice);
+        _flush = true;
+#endif
     }
 
 
-    void nextScore(void)
+    void startRender(void)
     {
-        initialiseChannels();
+        createFilters();
+        _renderSamples.clear();
+        _rendering = true;
+    }
 
-        if(++_scoreIndex >= 1) _scoreIndex = 0;
-        _scorePtr = (uint8_t*)_score[_scoreIndex];
+    void writeLittleEndian(std::ofstream& file, uint32_t value, int bytes)
+    {
+        for(int i=0; i<bytes; i++) file.put(char((value >>(i*8)) & 0xFF));
     }
 
-    void playMusic(void)
+    void writeWavHeader(std::ofstream& file, uint32_t sampleRate, uint16_t bitsPerSample, uint32_t dataSize)
     {
-        if(!Editor::getStartMusic()) return;
+        uint16_t blockAlign = bitsPerSample / 8;
+        file.write("RIFF", 4);  writeLittleEndian(file, 36 + dataSize, 4);  file.write("WAVE", 4);
+        file.write("fmt ", 4);  writeLittleEndian(file, 16, 4);  writeLittleEndian(file, 1, 2);  writeLittleEndian(file, 1, 2); // PCM, mono
+        writeLittleEndian(file, sampleRate, 4);  writeLittleEndian(file, sampleRate*blockAlign, 4);  writeLittleEndian(file, blockAlign, 2);  writeLittleEndian(file, bitsPerSample, 2);
+        file.write("data", 4);  writeLittleEndian(file, dataSize, 4);
+    }
 
-        static bool firstTime = true;
-        if(firstTime)
+    bool saveRender(const std::string& wavName, const std::string& statsName)
+    {
+        _rendering = false;
+        if(_renderSamples.empty())
         {
-            firstTime = false;
-            initialiseChannels();            
+            fprintf(stderr, "Audio::saveRender() : no audio was rendered\n");
+            return false;
         }
 
-        static int16_t midiDelay = 0;
-        static uint64_t prevFrameCounter = 0;
-        double frameTime = double(SDL_GetPerformanceCounter() - prevFrameCounter) / double(SDL_GetPerformanceFrequency());
-        if(frameTime > VSYNC_TIMING_60)
+        // Resample from the scanline rate, the history starts out full of the first sample so that there is no step at the start
+        std::vector<int16_t> output;
+        float history[AUDIO_TAPS];
+        for(int k=0; k<AUDIO_TAPS; k++) history[k] = (float(_renderSamples[0]) - 7.5f) * float(AUDIO_RENDER_SCALE);
+
+        double step = AUDIO_SOURCE_RATE / AUDIO_RENDER_RATE;
+        double phase = 0.0;
+        double input = history[0], dc = 0.0;
+        for(size_t index=1;;)
         {
-            prevFrameCounter = SDL_GetPerformanceCounter();        
-            if(midiDelay)
+            while(phase >= 1.0  &&  index < _renderSamples.size())
             {
-                midiDelay--; 
-                frameTime = 0.0;
+                phase -= 1.0;
+                memmove(&history[0], &history[1], (AUDIO_TAPS - 1)*sizeof(float));
+                history[AUDIO_TAPS - 1] = (float(_renderSamples[index++]) - 7.5f) * float(AUDIO_RENDER_SCALE);
+            }
+            if(phase >= 1.0) break;
+
+            double sample = filterSample(history, phase);
+            dc = sample - input + AUDIO_DC_BLOCKER*dc;
+            input = sample;
+
+            output.push_back(int16_t(std::min(std::max(dc, -32768.0), 32767.0)));
+            phase += step;
+        }
+
+        std::ofstream outfile(wavName, std::ios::binary | std::ios::out);
+        if(!outfile.is_open())
+        {
+            fprintf(stderr, "Audio::saveRender() : failed to open '%s'\n", wavName.c_str());
+            return false;
+        }
+
+        // Samples are little endian whatever the host is
+        std::vector<uint8_t> data;
+        data.reserve(output.size()*2);
+        for(int16_t sample : output)
+        {
+            data.push_back(uint8_t(LO_BYTE(uint16_t(sample))));
+            data.push_back(uint8_t(HI_BYTE(uint16_t(sample))));
+        }
+
+        writeWavHeader(outfile, AUDIO_RENDER_RATE, 16, uint32_t(data.size()));
+        outfile.write((char*)&data[0], data.size());
+        if(outfile.bad() || outfile.fail())
+        {
+            fprintf(stderr, "Audio::saveRender() : write error in '%s'\n", wavName.c_str());
+            return false;
+        }
+
+        if(statsName.empty()) return true;
+
+        std::ofstream statsFile(statsName, std::ios::out);
+        if(!statsFile.is_open())
+        {
+            fprintf(stderr, "Audio::saveRender() : failed to open '%s'\n", statsName.c_str());
+            return false;
+        }
 
-                // Start audio
-                Cpu::setRAM(GIGA_SOUND_TIMER, 0x01);
+        // One frame is a full set of scanlines, peak and RMS are relative to full scale
+        statsFile << "frame,peak,rms,peak_dbfs,rms_dbfs\n";
+        int64_t frames = int64_t(_renderSamples.size() / SCAN_LINES);
+        char line[128];
+        for(int64_t f=0; f<frames; f++)
+        {
+            size_t begin = std::min(size_t(double(f*SCAN_LINES) / step + 0.5), output.size());
+            size_t end = std::min(size_t(double((f + 1)*SCAN_LINES) / step + 0.5), output.size());
+
+            double peak = 0.0, sum = 0.0;
+            for(size_t i=begin; i<end; i++)
+            {
+                double sample = double(output[i]) / 32768.0;
+                peak = std::max(peak, fabs(sample));
+                sum += sample*sample;
             }
+            double rms = (end > begin) ? sqrt(sum / double(end - begin)) : 0.0;
+
+            sprintf(line, "%" PRId64 ",%.6f,%.6f,%.2f,%.2f\n", f, peak, rms, 20.0*log10(std::max(peak, 1e-6)), 20.0*log10(std::max(rms, 1e-6)));
+            statsFile << line;
         }
+        if(statsFile.bad() || statsFile.fail())
+        {
+            fprintf(stderr, "Audio::saveRender() : write error in '%s'\n", statsName.c_str());
+            return false;
+        }
+
+        return true;
+    }
 
-        while(midiDelay == 0)
+
+    void parseScore(void)
+    {
+        const Score& score = _scores[_scoreIndex];
+
+        _midiEvents.clear();
+        uint32_t frame = 0;
+        for(int i=0; i<score._size; i++)
         {
-            uint8_t command = *_scorePtr++;
+            uint8_t command = score._data[i];
             if(command & 0x80)
             {
                 // Start note
                 if((command & 0xF0) == 0x90)
                 {
-                    uint8_t channel = command & (GIGA_SOUND_CHANNELS - 1);  // spec supports up to 16 channels, Gigatron supports 4
-                    uint16_t note = *_scorePtr++;
-                    note = (note - 10) * 2 - 2;
-                    note = Cpu::getROM16(note + 0x0900, 1);
-                    Cpu::setRAM(GIGA_CH0_KEY_L + channel*GIGA_CHANNEL_OFFSET, uint8_t(LO_BYTE(note)));
-                    Cpu::setRAM(GIGA_CH0_KEY_H + channel*GIGA_CHANNEL_OFFSET, uint8_t(HI_BYTE(note)));
+                    if(i + 1 >= score._size) break;
+                    _midiEvents.push_back({frame, command, score._data[++i]});
                 }
                 // Stop note
                 else if((command & 0xF0) == 0x80)
                 {
-                    uint8_t channel = command & (GIGA_SOUND_CHANNELS - 1);  // spec supports up to 16 channels, Gigatron supports 4
-                    Cpu::setRAM(GIGA_CH0_KEY_L + channel*GIGA_CHANNEL_OFFSET, 0x00);
-                    Cpu::setRAM(GIGA_CH0_KEY_H + channel*GIGA_CHANNEL_OFFSET, 0x00);
+                    _midiEvents.push_back({frame, command, 0});
                 }
-                // Segment command
+                // Segment command, the address is the Gigatron's, so on the host it can only mean the end of the score
                 else if((command & 0xF0) == 0xD0)
                 {
-                    uint16_t segment = *_scorePtr++;
-                    segment |= HI_MASK((*_scorePtr++) <<8);
-                    _scorePtr = (uint8_t*)(uintptr_t)segment;
+                    break;
                 }
             }
-            // Delay n milliseconds where n = 8bit value
+            // Delay n frames where n = 8bit value
             else
             {
-                midiDelay = command;
+                frame += command;
             }
         }
+
+        _midiFrames = std::max(frame, uint32_t(1));
+        _midiFrame = 0;
+        _midiIndex = 0;
+    }
+
+    void fireMidiEvent(const MidiEvent& event)
+    {
+        uint16_t channel = (event._command & (GIGA_SOUND_CHANNELS - 1)) * GIGA_CHANNEL_OFFSET;  // spec supports up to 16 channels, Gigatron supports 4
+        uint16_t note = 0x0000;
+        if((event._command & 0xF0) == 0x90) note = Cpu::getROM16((event._note - 10) * 2 - 2 + 0x0900, 1);
+
+        Cpu::setRAM(GIGA_CH0_KEY_L + channel, uint8_t(LO_BYTE(note)));
+        Cpu::setRAM(GIGA_CH0_KEY_H + channel, uint8_t(HI_BYTE(note)));
+    }
+
+    void nextScore(void)
+    {
+        initialiseChannels();
+
+        if(++_scoreIndex >= int(sizeof(_scores) / sizeof(Score))) _scoreIndex = 0;
+        parseScore();
+    }
+
+    // Called on every emulated vSync, so playback follows emulated time whatever the host or turbo are doing
+    void playMusic(void)
+    {
+        if(!Editor::getStartMusic()) return;
+
+        static bool firstTime = true;
+        if(firstTime)
+        {
+            firstTime = false;
+            initialiseChannels();
+            parseScore();
+        }
+
+        while(_midiIndex < _midiEvents.size()  &&  _midiEvents[_midiIndex]._frame <= _midiFrame) fireMidiEvent(_midiEvents[_midiIndex++]);
+
+        // Start audio
+        Cpu::setRAM(GIGA_SOUND_TIMER, 0x01);
+
+        // Events after the last delay fire as the score wraps
+        if(++_midiFrame >= _midiFrames)
+        {
+            while(_midiIndex < _midiEvents.size()) fireMidiEvent(_midiEvents[_midiIndex++]);
+            _midiFrame = 0;
+            _midiIndex = 0;
+        }
     }
-}
\ No newline at end of file
+}
@@ -1,8 +1,14 @@
 #ifndef AUDIO_H
 #define AUDIO_H
 
+#include <stdint.h>
+#include <string>
+#include <fstream>
 
+
+#define GIGA_XOUT_MASK       0x0014
 #define GIGA_SOUND_TIMER     0x002C
+#define GIGA_SOUND_TABLE     0x0700
 #define GIGA_SOUND_CHANNELS  4
 #define GIGA_CHANNEL_OFFSET  0x0100
 
@@ -41,6 +47,9 @@ namespace Audio
 {
 #ifndef STAND_ALONE
     bool getRealTimeAudio(void);
+    bool getSynthesis(void);
+
+    void setSynthesis(bool synthesis);
 
     void initialise(void);
     void initialiseChannels(bool coldBoot=false);
@@ -51,6 +60,20 @@ namespace Audio
     void playSample(void);
     void clearQueue(void);
 
+    // High level synthesis, once a frame the 4 channels are run from their key and wave registers, the wave table and the sound timer,
+    // exactly as the ROM runs them one channel per scanline but on oscillators of their own; replaces sampling XOUT every scanline, so
+    // that sound carries on in turbo, (frames that don't fit in the ring are skipped whole rather than muted)
+    void synthesiseFrame(void);
+
+    // Offline rendering, (headless), every scanline's sample is kept from startRender() on, saveRender() band limits and resamples them
+    // to a 44.1kHz 16 bit WAV, and optionally writes each frame's peak and RMS as CSV
+    void startRender(void);
+    bool saveRender(const std::string& wavName, const std::string& statsName="");
+
+    // Mono PCM WAV header, every field is written little endian whatever the host is, (the samples are the caller's)
+    void writeWavHeader(std::ofstream& file, uint32_t sampleRate, uint16_t bitsPerSample, uint32_t dataSize);
+
+    // gtMIDI playback, the score is pre-parsed into frame stamped events that playMusic() fires one emulated vSync at a time
     void playMusic(void);
     void nextScore(void);
 #endif
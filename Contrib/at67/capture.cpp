@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include "audio.h"
+#include "capture.h"
+
+
+#define CAPTURE_FRAME_SIZE (CAPTURE_WIDTH*CAPTURE_HEIGHT)
+#define CAPTURE_IDLE_MS    2
+#define CAPTURE_COLOURS    64
+
+
+namespace Capture
+{
+    bool _enabled = false;
+    bool _y4m = false;
+
+    std::ofstream _videoFile;
+    std::ofstream _audioFile;
+    std::thread _writer;
+    std::atomic<bool> _running(false);
+
+    // Single producer, (the emulation), single consumer, (the writer), the indices only ever increase
+    std::vector<uint8_t> _frames;
+    std::atomic<uint64_t> _frameHead(0);
+    std::atomic<uint64_t> _frameTail(0);
+    uint64_t _framesDropped = 0;
+
+    std::vector<uint8_t> _samples;
+    std::atomic<uint64_t> _sampleHead(0);
+    std::atomic<uint64_t> _sampleTail(0);
+    uint64_t _samplesDropped = 0;
+
+    uint32_t _audioBytes = 0;
+    uint8_t _yuv[CAPTURE_COLOURS][3];
+
+
+    bool getEnabled(void) {return _enabled;}
+
+
+    // 8 bit samples have no byte order, only the header needs to be little endian
+    void writeWavHeader(uint32_t dataSize)
+    {
+        _audioFile.seekp(0);
+        Audio::writeWavHeader(_audioFile, CAPTURE_SAMPLE_RATE, 8, dataSize);
+    }
+
+    void writeFrame(const uint8_t* frame)
+    {
+        if(!_y4m)
+        {
+            _videoFile.write((char*)frame, CAPTURE_FRAME_SIZE);
+            return;
+        }
+
+        static uint8_t planes[3][CAPTURE_FRAME_SIZE];
+        for(int i=0; i<CAPTURE_FRAME_SIZE; i++)
+        {
+            const uint8_t* yuv = _yuv[frame[i]];
+            planes[0][i] = yuv[0];
+            planes[1][i] = yuv[1];
+            planes[2][i] = yuv[2];
+        }
+
+        _videoFile << "FRAME\n";
+        _videoFile.write((char*)planes, sizeof(planes));
+    }
+
+    // Drains both rings until capture is stopped and they are empty, sleeping briefly whenever there is nothing to do
+    void writer(void)
+    {
+        std::vector<uint8_t> samples;
+        for(;;)
+        {
+            bool running = _running;
+            bool idle = true;
+
+            uint64_t frameTail = _frameTail.load(std::memory_order_relaxed);
+            while(frameTail != _frameHead.load(std::memory_order_acquire))
+            {
+                writeFrame(&_frames[(frameTail % CAPTURE_RING_FRAMES) * CAPTURE_FRAME_SIZE]);
+                _frameTail.store(++frameTail, std::memory_order_release);
+                idle = false;
+            }
+
+            uint64_t sampleTail = _sampleTail.load(std::memory_order_relaxed);
+            uint64_t sampleHead = _sampleHead.load(std::memory_order_acquire);
+            if(sampleTail != sampleHead)
+            {
+                samples.clear();
+                for(uint64_t i=sampleTail; i<sampleHead; i++) samples.push_back(_samples[i % CAPTURE_RING_SAMPLES]);
+                _sampleTail.store(sampleHead, std::memory_order_release);
+                _audioFile.write((char*)&samples[0], samples.size());
+                _audioBytes += uint32_t(samples.size());
+                idle = false;
+            }
+
+            if(idle)
+            {
+                if(!running) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(CAPTURE_IDLE_MS));
+            }
+        }
+    }
+
+    bool start(const std::string& videoName, const std::string& audioName)
+    {
+        if(_enabled) stop();
+
+        _y4m = videoName.size() >= 4  &&  videoName.compare(videoName.size() - 4, 4, ".y4m") == 0;
+
+        _videoFile.open(videoName, std::ios::binary | std::ios::out);
+        if(!_videoFile.is_open())
+        {
+            fprintf(stderr, "Capture::start() : failed to open '%s'\n", videoName.c_str());
+            return false;
+        }
+        _audioFile.open(audioName, std::ios::binary | std::ios::out);
+        if(!_audioFile.is_open())
+        {
+            _videoFile.close();
+            fprintf(stderr, "Capture::start() : failed to open '%s'\n", audioName.c_str());
+            return false;
+        }
+
+        // BT.601 studio swing, the Gigatron's 2 bits per channel are 0, 85, 170 and 255
+        for(int i=0; i<CAPTURE_COLOURS; i++)
+        {
+            double r = double((i >>0) & 3) * 85.0, g = double((i >>2) & 3) * 85.0, b = double((i >>4) & 3) * 85.0;
+            _yuv[i][0] = uint8_t( 16.5 + 0.257*r + 0.504*g + 0.098*b);
+            _yuv[i][1] = uint8_t(128.5 - 0.148*r - 0.291*g + 0.439*b);
+            _yuv[i][2] = uint8_t(128.5 + 0.439*r - 0.368*g - 0.071*b);
+        }
+        if(_y4m) _videoFile << "YUV4MPEG2 W" << CAPTURE_WIDTH << " H" << CAPTURE_HEIGHT << " F31250:521 Ip A1:1 C444\n";
+
+        _audioBytes = 0;
+        writeWavHeader(0);
+
+        _frames.resize(CAPTURE_RING_FRAMES * CAPTURE_FRAME_SIZE);
+        _samples.resize(CAPTURE_RING_SAMPLES);
+        _frameHead = _frameTail = 0;
+        _sampleHead = _sampleTail = 0;
+        _framesDropped = _samplesDropped = 0;
+
+        _running = true;
+        _writer = std::thread(writer);
+        _enabled = true;
+
+        return true;
+    }
+
+    bool stop(void)
+    {
+        if(!_enabled) return false;
+
+        _enabled = false;
+        _running = false;
+        _writer.join();
+
+        writeWavHeader(_audioBytes);
+        bool success = _videoFile.good()  &&  _audioFile.good();
+        _videoFile.close();
+        _audioFile.close();
+
+        fprintf(stderr, "Capture::stop() : %" PRIu64 " frames, %" PRIu64 " dropped : %" PRIu64 " samples, %" PRIu64 " dropped\n", _frameHead.load(),
+                _framesDropped, _sampleHead.load(), _samplesDropped);
+        if(!success) fprintf(stderr, "Capture::stop() : failed writing capture files\n");
+
+        return success;
+    }
+
+
+    void captureFrame(const uint8_t video[VIDEO_OUT_HEIGHT][VIDEO_OUT_WIDTH])
+    {
+        if(!_enabled) return;
+
+        uint64_t head = _frameHead.load(std::memory_order_relaxed);
+        if(head - _frameTail.load(std::memory_order_acquire) >= CAPTURE_RING_FRAMES)
+        {
+            _framesDropped++;
+            return;
+        }
+
+        uint8_t* frame = &_frames[(head % CAPTURE_RING_FRAMES) * CAPTURE_FRAME_SIZE];
+        for(int y=0; y<CAPTURE_HEIGHT; y++)
+        {
+            // The scanline modes blank some of each group's lines, whatever they are the first line with pixels is the row
+            const uint8_t* line = video[y*4];
+            for(int i=0; i<4; i++)
+            {
+                line = video[y*4 + i];
+                bool pixels = false;
+                for(int x=0; x<CAPTURE_WIDTH  &&  !pixels; x++) pixels = (line[x] & (CAPTURE_COLOURS - 1)) != 0;
+                if(pixels) break;
+            }
+
+            for(int x=0; x<CAPTURE_WIDTH; x++) frame[y*CAPTURE_WIDTH + x] = line[x] & (CAPTURE_COLOURS - 1);
+        }
+
+        _frameHead.store(head + 1, std::memory_order_release);
+    }
+
+    void captureSample(uint8_t xout)
+    {
+        if(!_enabled) return;
+
+        uint64_t head = _sampleHead.load(std::memory_order_relaxed);
+        if(head - _sampleTail.load(std::memory_order_acquire) >= CAPTURE_RING_SAMPLES)
+        {
+            _samplesDropped++;
+            return;
+        }
+
+        _samples[head % CAPTURE_RING_SAMPLES] = xout & 0xF0;
+        _sampleHead.store(head + 1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <string>
+
+#include "cpu.h"
+
+
+#define CAPTURE_VIDEO "capture.y4m"
+#define CAPTURE_AUDIO "capture.wav"
+
+#define CAPTURE_WIDTH        160
+#define CAPTURE_HEIGHT       120
+#define CAPTURE_RING_FRAMES  256
+#define CAPTURE_RING_SAMPLES (CAPTURE_RING_FRAMES*521)
+#define CAPTURE_SAMPLE_RATE  31250 // one sample per scanline, (6.25MHz / 200 clocks)
+
+
+// Video and audio capture of the interactive emulator instance; every vSync the native 160x120 indexed frame, (the first line of each
+// group of 4 VGA lines that has any pixels in it), and every hSync the audio sample are pushed into lock free rings, a writer thread
+// drains them to disk. The emulation never waits for the writer, frames and samples that don't fit are dropped and counted instead.
+// The video is Y4M, (4:4:4 at 59.98Hz), if the filename ends in .y4m and raw indexed bytes, (OUT & 0x3F), otherwise, audio is WAV
+namespace Capture
+{
+    bool getEnabled(void);
+
+    bool start(const std::string& videoName, const std::string& audioName);
+    bool stop(void);
+
+    void captureFrame(const uint8_t video[VIDEO_OUT_HEIGHT][VIDEO_OUT_WIDTH]);
+    void captureSample(uint8_t xout);
+}
+
+#endif
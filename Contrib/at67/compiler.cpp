@@ -4199,8 +4199,11 @@ REDO:
         Memory::getFreeRAM(Memory::FitDescending, USER_STR_SIZE + 2, USER_CODE_START, _runtimeStart, _strWorkArea);
     }
 
-    bool compile(const std::string& inputFilename, const std::string& outputFilename)
+    bool compile(const std::string& inputFilename, const std::string& outputFilename, int sizeRAM)
     {
+        // The allocator starts from the target's memory model every time, (a 64K _runtimeStart_ pragma can still raise it)
+        Memory::setSizeRAM(sizeRAM);
+
         Assembler::clearAssembler();
         clearCompiler();
 
@@ -435,7 +435,7 @@ namespace Compiler
     void addLabelToJumpCC(std::vector<VasmLine>& vasm, const std::string& label);
     void addLabelToJump(std::vector<VasmLine>& vasm, const std::string& label);
 
-    bool compile(const std::string& inputFilename, const std::string& outputFilename);
+    bool compile(const std::string& inputFilename, const std::string& outputFilename, int sizeRAM);
 }
 
 #endif
\ No newline at end of file
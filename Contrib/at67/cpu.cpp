@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <fstream>
 #include <iomanip>
@@ -10,12 +11,19 @@
 #include "cpu.h"
 
 #ifndef STAND_ALONE
+#ifndef HEADLESS
 #include <SDL.h>
+#endif
 #include "audio.h"
 #include "loader.h"
 #include "editor.h"
 #include "timing.h"
+#include "rewind.h"
+#include "replay.h"
+#include "profiler.h"
 #include "graphics.h"
+#include "hle.h"
+#include "capture.h"
 #include "gigatron_0x1c.h"
 #include "gigatron_0x20.h"
 #include "gigatron_0x28.h"
@@ -39,36 +47,29 @@ namespace Cpu
     const uint8_t _endianBytes[] = {0x00, 0x01, 0x02, 0x03};
 
     int _numRoms = 0;
-    int _romIndex = 0;
-    int _vCpuInstPerFrame = 0;
-    int _vCpuInstPerFrameMax = 0;
-    float _vCpuUtilisation = 0.0;
-
-    bool _coldBoot = true;
-    bool _isInReset = false;
-    bool _checkRomType = true;
-    bool _debugging = false;
-    bool _initAudio = true;
+
     bool _consoleSaveFile = true;
 
-    std::vector<uint8_t> _RAM;
-    uint8_t _ROM[ROM_SIZE][2];
+    // The interactive instance, every thread starts out pointing at it
+    Emulator _defaultEmulator;
+    thread_local Emulator* _emulator = &_defaultEmulator;
+
     std::vector<uint8_t*> _romFiles;
-    RomType _romType = ROMERR;
     std::map<std::string, RomType> _romTypeMap = {{"ROMV1", ROMv1}, {"ROMV2", ROMv2}, {"ROMV3", ROMv3}, {"ROMV4", ROMv4}, {"ROMV5A", ROMv5a}, {"DEVROM", DEVROM}};
     std::map<RomType, std::string> _romTypeStr = {{ROMv1, "ROMv1"}, {ROMv2, "ROMv2"}, {ROMv3, "ROMv3"}, {ROMv4, "ROMv4"}, {ROMv5a, "ROMv5A"}, {DEVROM, "DEVROM"}};
 
-    std::vector<uint8_t> _scanlinesRom0;
-    std::vector<uint8_t> _scanlinesRom1;
-    int _scanlineMode = ScanlineMode::Normal;
 
     std::vector<InternalGt1> _internalGt1s;
 
+    Emulator* getEmulator(void) {return _emulator;}
+    void setEmulator(Emulator* emulator) {_emulator = emulator;}
+
     int getNumRoms(void) {return _numRoms;}
-    int getRomIndex(void) {return _romIndex;}
+    int getRomIndex(void) {return _emulator->_romIndex;}
 
-    uint8_t* getPtrToROM(int& romSize) {romSize = sizeof(_ROM); return (uint8_t*)_ROM;}
-    RomType getRomType(void) {return _romType;}
+    uint8_t* getPtrToROM(int& romSize) {romSize = sizeof(_emulator->_ROM); return (uint8_t*)_emulator->_ROM;}
+    uint8_t* getPtrToRAM(int& ramSize) {ramSize = int(_emulator->_machine._sizeRAM); return _emulator->_machine._RAM;}
+    RomType getRomType(void) {return _emulator->_machine._romType;}
     std::map<std::string, RomType>& getRomTypeMap(void) {return _romTypeMap;}
 
     bool getRomTypeStr(RomType romType, std::string& romTypeStr)
@@ -85,40 +86,6 @@ namespace Cpu
     }
 
 
-//#define COLLECT_INST_STATS
-#if defined(COLLECT_INST_STATS)
-    struct InstCount
-    {
-        uint8_t _inst = 0;
-        uint64_t _count = 0;
-    };
-
-    uint64_t _totalCount = 0;
-    float _totalPercent = 0.0f;
-    std::vector<InstCount> _instCounts(256);
-
-    void displayInstCounts(void)
-    {
-        std::sort(_instCounts.begin(), _instCounts.end(), [](const InstCount& a, const InstCount& b)
-        {
-            return (a._count > b._count);
-        });
-
-        for(int i=0; i<_instCounts.size(); i++)
-        {
-            float percent = float(_instCounts[i]._count)/float(_totalCount)*100.0f;
-            if(percent > 1.0f)
-            {
-                _totalPercent += percent;
-                fprintf(stderr, "inst:%02x count:%012lld %.1f%%\n", _instCounts[i]._inst, _instCounts[i]._count, percent);
-            }
-        }
-
-        fprintf(stderr, "Total instructions:%lld\n", _totalCount);
-        fprintf(stderr, "Total percentage:%f\n", _totalPercent);
-    }
-#endif
-
 #ifdef _WIN32
     void enableWin32ConsoleSaveFile(bool consoleSaveFile)
     {
@@ -170,89 +137,98 @@ namespace Cpu
 
     void patchSYS_Exec_88(void)
     {
-        _ROM[0x00AD][ROM_INST] = 0x00;
-        _ROM[0x00AD][ROM_DATA] = 0x00;
+        auto& rom = _emulator->_ROM;
 
-        _ROM[0x00AF][ROM_INST] = 0x00;
-        _ROM[0x00AF][ROM_DATA] = 0x67;
+        rom[0x00AD][ROM_INST] = 0x00;
+        rom[0x00AD][ROM_DATA] = 0x00;
 
-        _ROM[0x00B5][ROM_INST] = 0xDC;
-        _ROM[0x00B5][ROM_DATA] = 0xCF;
+        rom[0x00AF][ROM_INST] = 0x00;
+        rom[0x00AF][ROM_DATA] = 0x67;
 
-        _ROM[0x00B6][ROM_INST] = 0x80;
-        _ROM[0x00B6][ROM_DATA] = 0x23;
+        rom[0x00B5][ROM_INST] = 0xDC;
+        rom[0x00B5][ROM_DATA] = 0xCF;
 
-        _ROM[0x00BB][ROM_INST] = 0x80;
-        _ROM[0x00BB][ROM_DATA] = 0x00;
+        rom[0x00B6][ROM_INST] = 0x80;
+        rom[0x00B6][ROM_DATA] = 0x23;
+
+        rom[0x00BB][ROM_INST] = 0x80;
+        rom[0x00BB][ROM_DATA] = 0x00;
     }
 
     void patchScanlineModeVideoB(void)
     {
-        _ROM[0x01C2][ROM_INST] = 0x14;
-        _ROM[0x01C2][ROM_DATA] = 0x01;
+        auto& rom = _emulator->_ROM;
+
+        rom[0x01C2][ROM_INST] = 0x14;
+        rom[0x01C2][ROM_DATA] = 0x01;
 
-        _ROM[0x01C9][ROM_INST] = 0x01;
-        _ROM[0x01C9][ROM_DATA] = 0x09;
+        rom[0x01C9][ROM_INST] = 0x01;
+        rom[0x01C9][ROM_DATA] = 0x09;
 
-        _ROM[0x01CA][ROM_INST] = 0x90;
-        _ROM[0x01CA][ROM_DATA] = 0x01;
+        rom[0x01CA][ROM_INST] = 0x90;
+        rom[0x01CA][ROM_DATA] = 0x01;
 
-        _ROM[0x01CB][ROM_INST] = 0x01;
-        _ROM[0x01CB][ROM_DATA] = 0x0A;
+        rom[0x01CB][ROM_INST] = 0x01;
+        rom[0x01CB][ROM_DATA] = 0x0A;
 
-        _ROM[0x01CC][ROM_INST] = 0x8D;
-        _ROM[0x01CC][ROM_DATA] = 0x00;
+        rom[0x01CC][ROM_INST] = 0x8D;
+        rom[0x01CC][ROM_DATA] = 0x00;
 
-        _ROM[0x01CD][ROM_INST] = 0xC2;
-        _ROM[0x01CD][ROM_DATA] = 0x0A;
+        rom[0x01CD][ROM_INST] = 0xC2;
+        rom[0x01CD][ROM_DATA] = 0x0A;
 
-        _ROM[0x01CE][ROM_INST] = 0x00;
-        _ROM[0x01CE][ROM_DATA] = 0xD4;
+        rom[0x01CE][ROM_INST] = 0x00;
+        rom[0x01CE][ROM_DATA] = 0xD4;
 
-        _ROM[0x01CF][ROM_INST] = 0xFC;
-        _ROM[0x01CF][ROM_DATA] = 0xFD;
+        rom[0x01CF][ROM_INST] = 0xFC;
+        rom[0x01CF][ROM_DATA] = 0xFD;
 
-        _ROM[0x01D0][ROM_INST] = 0xC2;
-        _ROM[0x01D0][ROM_DATA] = 0x0C;
+        rom[0x01D0][ROM_INST] = 0xC2;
+        rom[0x01D0][ROM_DATA] = 0x0C;
 
-        _ROM[0x01D1][ROM_INST] = 0x02;
-        _ROM[0x01D1][ROM_DATA] = 0x00;
+        rom[0x01D1][ROM_INST] = 0x02;
+        rom[0x01D1][ROM_DATA] = 0x00;
 
-        _ROM[0x01D2][ROM_INST] = 0x02;
-        _ROM[0x01D2][ROM_DATA] = 0x00;
+        rom[0x01D2][ROM_INST] = 0x02;
+        rom[0x01D2][ROM_DATA] = 0x00;
 
-        _ROM[0x01D3][ROM_INST] = 0x02;
-        _ROM[0x01D3][ROM_DATA] = 0x00;
+        rom[0x01D3][ROM_INST] = 0x02;
+        rom[0x01D3][ROM_DATA] = 0x00;
     }
 
     void patchScanlineModeVideoC(void)
     {
-        _ROM[0x01DA][ROM_INST] = 0xFC;
-        _ROM[0x01DA][ROM_DATA] = 0xFD;
+        auto& rom = _emulator->_ROM;
 
-        _ROM[0x01DB][ROM_INST] = 0xC2;
-        _ROM[0x01DB][ROM_DATA] = 0x0C;
+        rom[0x01DA][ROM_INST] = 0xFC;
+        rom[0x01DA][ROM_DATA] = 0xFD;
 
-        _ROM[0x01DC][ROM_INST] = 0x02;
-        _ROM[0x01DC][ROM_DATA] = 0x00;
+        rom[0x01DB][ROM_INST] = 0xC2;
+        rom[0x01DB][ROM_DATA] = 0x0C;
 
-        _ROM[0x01DD][ROM_INST] = 0x02;
-        _ROM[0x01DD][ROM_DATA] = 0x00;
+        rom[0x01DC][ROM_INST] = 0x02;
+        rom[0x01DC][ROM_DATA] = 0x00;
 
-        _ROM[0x01DE][ROM_INST] = 0x02;
-        _ROM[0x01DE][ROM_DATA] = 0x00;
+        rom[0x01DD][ROM_INST] = 0x02;
+        rom[0x01DD][ROM_DATA] = 0x00;
+
+        rom[0x01DE][ROM_INST] = 0x02;
+        rom[0x01DE][ROM_DATA] = 0x00;
     }
 
     void patchTitleIntoRom(const std::string& title)
     {
+        auto& rom = _emulator->_ROM;
+
         int minLength = std::min(int(title.size()), MAX_TITLE_CHARS);
-        for(int i=0; i<minLength; i++) _ROM[ROM_TITLE_ADDRESS + i][ROM_DATA] = title[i];
-        for(int i=minLength; i<MAX_TITLE_CHARS; i++) _ROM[ROM_TITLE_ADDRESS + i][ROM_DATA] = ' ';
+        for(int i=0; i<minLength; i++) rom[ROM_TITLE_ADDRESS + i][ROM_DATA] = title[i];
+        for(int i=minLength; i<MAX_TITLE_CHARS; i++) rom[ROM_TITLE_ADDRESS + i][ROM_DATA] = ' ';
     }
 
     char filebuffer[RAM_SIZE_HI];
     bool patchSplitGt1IntoRom(const std::string& splitGt1path, const std::string& splitGt1name, uint16_t startAddress, InternalGt1Id gt1Id)
     {
+        auto& rom = _emulator->_ROM;
         std::streampos filelength = 0;
 
         // Instruction ROM
@@ -274,7 +250,7 @@ namespace Cpu
             fprintf(stderr, "Cpu::patchSplitGt1IntoRom() : failed to read %s ROM file.\n", std::string(splitGt1path + "_ti").c_str());
             return false;
         }
-        for(int i=0; i<int(filelength); i++) _ROM[startAddress + i][ROM_INST] = filebuffer[i];
+        for(int i=0; i<int(filelength); i++) rom[startAddress + i][ROM_INST] = filebuffer[i];
 
         // Data ROM
         std::ifstream romfile_td(splitGt1path + "_td", std::ios::binary | std::ios::in);
@@ -295,53 +271,63 @@ namespace Cpu
             fprintf(stderr, "Cpu::patchSplitGt1IntoRom() : failed to read %s ROM file.\n", std::string(splitGt1path + "_td").c_str());
             return false;
         }
-        for(int i=0; i<int(filelength); i++) _ROM[startAddress + i][ROM_DATA] = filebuffer[i];
+        for(int i=0; i<int(filelength); i++) rom[startAddress + i][ROM_DATA] = filebuffer[i];
 
         // Replace internal gt1 menu option with split gt1
-        _ROM[_internalGt1s[gt1Id]._patch + 0][ROM_DATA] = LO_BYTE(startAddress);
-        _ROM[_internalGt1s[gt1Id]._patch + 1][ROM_DATA] = HI_BYTE(startAddress);
+        rom[_internalGt1s[gt1Id]._patch + 0][ROM_DATA] = LO_BYTE(startAddress);
+        rom[_internalGt1s[gt1Id]._patch + 1][ROM_DATA] = HI_BYTE(startAddress);
 
         // Replace internal gt1 menu option name with split gt1 name
         int minLength = std::min(uint8_t(splitGt1name.size()), _internalGt1s[gt1Id]._length);
-        for(int i=0; i<minLength; i++) _ROM[_internalGt1s[gt1Id]._string + i][ROM_DATA] = splitGt1name[i];
-        for(int i=minLength; i<_internalGt1s[gt1Id]._length; i++) _ROM[_internalGt1s[gt1Id]._string + i][ROM_DATA] = ' ';
+        for(int i=0; i<minLength; i++) rom[_internalGt1s[gt1Id]._string + i][ROM_DATA] = splitGt1name[i];
+        for(int i=minLength; i<_internalGt1s[gt1Id]._length; i++) rom[_internalGt1s[gt1Id]._string + i][ROM_DATA] = ' ';
 
         return true;
     }
 
 
 #ifndef STAND_ALONE
-    int _vgaX = 0, _vgaY = 0;
-    int _hSync = 0, _vSync = 0;
-    int64_t _clockStall = CLOCK_RESET;
-    int64_t _clock = CLOCK_RESET;
-    uint8_t _IN = 0xFF, _XOUT = 0x00;
-    uint16_t _vPC = 0x0200;
-    State _stateS, _stateT;
+    // Serialises the services that every instance shares, (Memory, Editor, Assembler and Compiler)
+    std::recursive_mutex _sharedMutex;
+
+    const uint64_t* _ntvTraps = Editor::getNtvTraps();
+    const uint64_t* _vpcTraps = Editor::getVpcTraps();
 
 #ifdef _WIN32
     HWND _consoleWindowHWND;
 #endif
 
-    bool getColdBoot(void) {return _coldBoot;}
-    bool getIsInReset(void) {return _isInReset;}
-    State& getStateS(void) {return _stateS;}
-    State& getStateT(void) {return _stateT;}
-    int64_t getClock(void) {return _clock;}
-    uint8_t getIN(void) {return _IN;}
-    uint8_t getXOUT(void) {return _XOUT;}
-    uint16_t getVPC(void) {return _vPC;}
-    uint8_t getRAM(uint16_t address) {return _RAM[address & (Memory::getSizeRAM()-1)];}
-    uint8_t getROM(uint16_t address, int page) {return _ROM[address & (ROM_SIZE-1)][page & 0x01];}
-    uint16_t getRAM16(uint16_t address) {return _RAM[address & (Memory::getSizeRAM()-1)] | (_RAM[(address+1) & (Memory::getSizeRAM()-1)]<<8);}
-    uint16_t getROM16(uint16_t address, int page) {return _ROM[address & (ROM_SIZE-1)][page & 0x01] | (_ROM[(address+1) & (ROM_SIZE-1)][page & 0x01]<<8);}
-    float getvCpuUtilisation(void) {return _vCpuUtilisation;}
-
-    void setColdBoot(bool coldBoot) {_coldBoot = coldBoot;}
-    void setIsInReset(bool isInReset) {_isInReset = isInReset;}
-    void setClock(int64_t clock) {_clock = clock;}
-    void setIN(uint8_t in) {_IN = in;}
-    void setXOUT(uint8_t xout) {_XOUT = xout;}
+    std::recursive_mutex& getSharedMutex(void) {return _sharedMutex;}
+
+    bool getColdBoot(void) {return _emulator->_machine._coldBoot;}
+    bool getIsInReset(void) {return _emulator->_machine._isInReset;}
+    State& getStateS(void) {return _emulator->_machine._stateS;}
+    State& getStateT(void) {return _emulator->_machine._stateT;}
+    int64_t getClock(void) {return _emulator->_machine._clock;}
+    uint8_t getIN(void) {return _emulator->_machine._IN;}
+    uint8_t getXOUT(void) {return _emulator->_machine._XOUT;}
+    uint16_t getVPC(void) {return _emulator->_machine._vPC;}
+    int getSizeRAM(void) {return int(_emulator->_machine._sizeRAM);}
+    uint8_t getRAM(uint16_t address) {const Machine& m = _emulator->_machine; return m._RAM[address & (m._sizeRAM-1)];}
+    uint8_t getROM(uint16_t address, int page) {return _emulator->_ROM[address & (ROM_SIZE-1)][page & 0x01];}
+    uint16_t getRAM16(uint16_t address) {const Machine& m = _emulator->_machine; return m._RAM[address & (m._sizeRAM-1)] | (m._RAM[(address+1) & (m._sizeRAM-1)]<<8);}
+    uint16_t getROM16(uint16_t address, int page) {auto& rom = _emulator->_ROM; return rom[address & (ROM_SIZE-1)][page & 0x01] | (rom[(address+1) & (ROM_SIZE-1)][page & 0x01]<<8);}
+    float getvCpuUtilisation(void) {return _emulator->_machine._vCpuUtilisation;}
+    bool getVCpuHle(void) {return _emulator->_vCpuHle;}
+
+    void setColdBoot(bool coldBoot) {_emulator->_machine._coldBoot = coldBoot;}
+    void setIsInReset(bool isInReset) {_emulator->_machine._isInReset = isInReset;}
+    void setClock(int64_t clock) {_emulator->_machine._clock = clock;}
+    void setIN(uint8_t in)
+    {
+        // While replaying the recording owns IN, when recording only transitions are logged
+        if(Replay::getMode() == Replay::Replaying) return;
+        if(Replay::getMode() == Replay::Recording  &&  in != _emulator->_machine._IN) Replay::recordIN(in);
+
+        _emulator->_machine._IN = in;
+    }
+    void setXOUT(uint8_t xout) {_emulator->_machine._XOUT = xout;}
+    void setVCpuHle(bool vCpuHle) {_emulator->_vCpuHle = vCpuHle;}
 
     void setRAM(uint16_t address, uint8_t data)
     {
@@ -349,13 +335,14 @@ namespace Cpu
         if(address == ZERO_CONST_ADDRESS  &&  data != 0x00) {fprintf(stderr, "Cpu::setRAM() : Warning writing to address : 0x%04x : 0x%02x\n", address, data); return;}
         if(address == ONE_CONST_ADDRESS   &&  data != 0x01) {fprintf(stderr, "Cpu::setRAM() : Warning writing to address : 0x%04x : 0x%02x\n", address, data); return;}
 
-        _RAM[address & (Memory::getSizeRAM()-1)] = data;
+        Machine& m = _emulator->_machine;
+        m._RAM[address & (m._sizeRAM-1)] = data;
     }
 
     void setROM(uint16_t base, uint16_t address, uint8_t data)
     {
         uint16_t offset = (address - base) / 2;
-        _ROM[base + offset][address & 0x01] = data;
+        _emulator->_ROM[base + offset][address & 0x01] = data;
     }
 
     void setRAM16(uint16_t address, uint16_t data)
@@ -364,13 +351,14 @@ namespace Cpu
         if(address == 0x0000) return;
         if(address == 0x0080) return;
 
-        _RAM[address & (Memory::getSizeRAM()-1)] = uint8_t(LO_BYTE(data));
-        _RAM[(address+1) & (Memory::getSizeRAM()-1)] = uint8_t(HI_BYTE(data));
+        Machine& m = _emulator->_machine;
+        m._RAM[address & (m._sizeRAM-1)] = uint8_t(LO_BYTE(data));
+        m._RAM[(address+1) & (m._sizeRAM-1)] = uint8_t(HI_BYTE(data));
     }
 
     void setSizeRAM(size_t size)
     {
-        _RAM.resize(size);
+        _emulator->_machine._sizeRAM = uint32_t(size);
     }
 
     void clearUserRAM(void)
@@ -391,14 +379,15 @@ namespace Cpu
     void setROM16(uint16_t base, uint16_t address, uint16_t data)
     {
         uint16_t offset = (address - base) / 2;
-        _ROM[base + offset][address & 0x01] = uint8_t(LO_BYTE(data));
-        _ROM[base + offset][(address+1) & 0x01] = uint8_t(HI_BYTE(data));
+        _emulator->_ROM[base + offset][address & 0x01] = uint8_t(LO_BYTE(data));
+        _emulator->_ROM[base + offset][(address+1) & 0x01] = uint8_t(HI_BYTE(data));
     }
 
     void setRomType(void)
     {
-        if(!_checkRomType) return;
-        _checkRomType = false;
+        Machine& m = _emulator->_machine;
+        if(!m._checkRomType) return;
+        m._checkRomType = false;
 
         uint8_t romType = ROMERR;
 #if 1
@@ -432,14 +421,16 @@ namespace Cpu
         {
             case ROMv1:
             {
-                _romType = (RomType)romType;
+                m._romType = (RomType)romType;
 
                 // Patches SYS_Exec_88 loader to accept page0 segments as the first segment and works with 64KB SRAM hardware
                 patchSYS_Exec_88();
 
+                // A reset keeps the ROM, so any scanline mode patch is undone before the code is saved again
+                if(_emulator->_scanlineMode != ScanlineMode::Normal) restoreScanlineModes();
                 saveScanlineModes();
                 setRAM(VIDEO_MODE_D, 0xF3);
-                _scanlineMode = ScanlineMode::Normal;
+                _emulator->_scanlineMode = ScanlineMode::Normal;
             }
             break;
 
@@ -449,7 +440,7 @@ namespace Cpu
             case ROMv5a:
             case DEVROM:
             {
-                _romType = (RomType)romType;
+                m._romType = (RomType)romType;
                 setRAM(VIDEO_MODE_D, 0xEC);
                 setRAM(VIDEO_MODE_B, 0x0A);
                 setRAM(VIDEO_MODE_C, 0x0A);
@@ -469,27 +460,20 @@ namespace Cpu
 
     void saveScanlineModes(void)
     {
-        for(int i=0x01C2; i<=0x01DE; i++)
-        {
-            _scanlinesRom0.push_back(_ROM[i][ROM_INST]);
-            _scanlinesRom1.push_back(_ROM[i][ROM_DATA]);
-        }
+        memcpy(_emulator->_scanlinesROM, &_emulator->_ROM[ROM_SCANLINES_START], sizeof(_emulator->_scanlinesROM));
     }
 
     void restoreScanlineModes(void)
     {
-        for(int i=0x01C2; i<=0x01DE; i++)
-        {
-            _ROM[i][ROM_INST] = _scanlinesRom0[i - 0x01C2];
-            _ROM[i][ROM_DATA] = _scanlinesRom1[i - 0x01C2];
-        }
+        memcpy(&_emulator->_ROM[ROM_SCANLINES_START], _emulator->_scanlinesROM, sizeof(_emulator->_scanlinesROM));
     }
 
     void swapScanlineMode(void)
     {
-        if(++_scanlineMode == ScanlineMode::NumScanlineModes-1) _scanlineMode = ScanlineMode::Normal;
+        int& scanlineMode = _emulator->_scanlineMode;
+        if(++scanlineMode == ScanlineMode::NumScanlineModes-1) scanlineMode = ScanlineMode::Normal;
 
-        switch(_scanlineMode)
+        switch(scanlineMode)
         {
             case Normal:  restoreScanlineModes();                               break;
             case VideoB:  patchScanlineModeVideoB();                            break;
@@ -505,6 +489,26 @@ namespace Cpu
         for(int i=0; i<len; i++) mem[i] = uint8_t(rand());
     }
 
+    // RAM, CPU registers and the undef generator all follow from the seed, (xorshift32, zero is not a valid state)
+    void garbleMachine(Machine& m, uint32_t seed)
+    {
+        m._undefSeed = (seed) ? seed : 1;
+
+        uint32_t state = m._undefSeed;
+        uint8_t* mem[2] = {m._RAM, (uint8_t*)&m._stateS};
+        size_t len[2] = {sizeof(m._RAM), sizeof(m._stateS)};
+        for(int i=0; i<2; i++)
+        {
+            for(size_t j=0; j<len[i]; j++)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                mem[i][j] = uint8_t(state);
+            }
+        }
+    }
+
     void createRomHeader(const uint8_t* rom, const std::string& filename, const std::string& name, int length)
     {
         std::ofstream outfile(filename);
@@ -533,26 +537,255 @@ namespace Cpu
         outfile << "\n};" << std::endl;
     }
 
+    // Pre-decoded native instructions, indexed by opcode; the instruction that executes is the pipelined _IR, (not _ROM[_PC]), and the ROM can be
+    // patched at runtime, so decoding by opcode rather than by ROM address keeps the table tiny, always valid and resident in L1
+    enum MicroOpHandler {OpLdD=0, OpLdRamD, OpLdRamYX, OpStRamD, OpOraOutYXInc, OpAddD, OpAddRamD, OpSubD, OpBraD, OpAlu, OpStore, OpJump, OpBranch};
+    enum MicroOpAddr {AddrD=0, AddrX=1, AddrYD=2, AddrYX=3};
+    enum MicroOpDest {DestNone=0, DestAC, DestX, DestY, DestOUT};
+
+    struct MicroOp
+    {
+        uint8_t _handler; // MicroOpHandler
+        uint8_t _addr;    // MicroOpAddr, (bit 2 set for X++)
+        uint8_t _bus;     // 0=D, 1=RAM, 2=AC, 3=IN
+        uint8_t _dest;    // MicroOpDest with the ALU operation in the upper nibble, condition mask for branches
+    };
+
+    MicroOp _microOps[256];
+
+    void decodeMicroOps(void)
+    {
+        for(int i=0; i<256; i++)
+        {
+            int ins = i >> 5;       // Instruction
+            int mod = (i >> 2) & 7; // Addressing mode (or condition)
+            int bus = i & 3;        // Busmode
+
+            MicroOp& op = _microOps[i];
+            op._bus = uint8_t(bus);
+            op._addr = AddrD;
+            op._dest = DestNone;
+
+            // Jumps and branches, bus supplies the target
+            if(ins == 7)
+            {
+                op._handler = uint8_t((mod == 0) ? OpJump : OpBranch);
+                op._dest = uint8_t(mod);
+                continue;
+            }
+
+            // Mode decoder, _AC and _OUT loading is disabled during RAM writes
+            bool W = (ins == 6);
+            switch(mod)
+            {
+                case 0: op._dest = uint8_t(W ? DestNone : DestAC);                         break;
+                case 1: op._dest = uint8_t(W ? DestNone : DestAC);  op._addr = AddrX;      break;
+                case 2: op._dest = uint8_t(W ? DestNone : DestAC);  op._addr = AddrYD;     break;
+                case 3: op._dest = uint8_t(W ? DestNone : DestAC);  op._addr = AddrYX;     break;
+                case 4: op._dest = DestX;                                                  break;
+                case 5: op._dest = DestY;                                                  break;
+                case 6: op._dest = uint8_t(W ? DestNone : DestOUT);                        break;
+                case 7: op._dest = uint8_t(W ? DestNone : DestOUT); op._addr = AddrYX | 4; break;
+
+                default: break;
+            }
+            op._dest |= uint8_t(ins << 4);
+            op._handler = uint8_t(W ? OpStore : OpAlu);
+        }
+
+        // Statistically most common instructions get their own handlers
+        _microOps[0x00]._handler = OpLdD;         // ld D
+        _microOps[0x01]._handler = OpLdRamD;      // ld [D]
+        _microOps[0x0D]._handler = OpLdRamYX;     // ld [Y,X]
+        _microOps[0xC2]._handler = OpStRamD;      // st [D]
+        _microOps[0x5D]._handler = OpOraOutYXInc; // ora [Y,X++],OUT
+        _microOps[0x80]._handler = OpAddD;        // adda D
+        _microOps[0x81]._handler = OpAddRamD;     // adda [D]
+        _microOps[0xA0]._handler = OpSubD;        // suba D
+        _microOps[0xFC]._handler = OpBraD;        // bra D
+    }
+
+    uint64_t getRomHash(void) {return _emulator->_romHash;}
+
+    // FNV-1a of the current instance's ROM, identifies the ROM a snapshot was taken with; must be called whenever a ROM image is
+    // loaded, before it boots, as the emulator patches the ROM in place, (e.g. SYS_Exec_88 and the scanline modes on ROMv1)
+    void hashRom(void)
+    {
+        const uint8_t* rom = (const uint8_t*)_emulator->_ROM;
+
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for(int i=0; i<int(sizeof(_emulator->_ROM)); i++) hash = (hash ^ rom[i]) * 0x00000100000001B3ull;
+
+        _emulator->_romHash = hash;
+    }
+
+    void takeSnapshot(Snapshot& snapshot)
+    {
+        snapshot._header = SnapshotHeader();
+        snapshot._header._endianness = uint32_t(getHostEndianness());
+        snapshot._header._machineSize = uint32_t(sizeof(Machine));
+        snapshot._header._romHash = getRomHash();
+        memcpy(&snapshot._machine, &_emulator->_machine, sizeof(Machine));
+    }
+
+    bool restoreSnapshot(const Snapshot& snapshot)
+    {
+        const SnapshotHeader& header = snapshot._header;
+        if(memcmp(header._name, SNAPSHOT_IDENTIFIER, sizeof(header._name))  ||  header._version != SNAPSHOT_VERSION  ||  header._machineSize != sizeof(Machine))
+        {
+            fprintf(stderr, "Cpu::restoreSnapshot() : snapshot is from a different version of the emulator\n");
+            return false;
+        }
+        if(header._endianness != uint32_t(getHostEndianness()))
+        {
+            fprintf(stderr, "Cpu::restoreSnapshot() : snapshot is from a host with different endianness\n");
+            return false;
+        }
+        if(header._romHash != getRomHash())
+        {
+            fprintf(stderr, "Cpu::restoreSnapshot() : snapshot was taken with a different ROM\n");
+            return false;
+        }
+
+        memcpy(&_emulator->_machine, &snapshot._machine, sizeof(Machine));
+
+        return true;
+    }
+
+    bool saveSnapshotFile(const std::string& filename)
+    {
+        Snapshot* snapshot = new (std::nothrow) Snapshot;
+        if(!snapshot)
+        {
+            fprintf(stderr, "Cpu::saveSnapshotFile() : out of memory!\n");
+            return false;
+        }
+
+        takeSnapshot(*snapshot);
+
+        bool success = true;
+        std::ofstream outfile(filename, std::ios::binary | std::ios::out);
+        if(!outfile.is_open())
+        {
+            fprintf(stderr, "Cpu::saveSnapshotFile() : failed to open '%s'\n", filename.c_str());
+            success = false;
+        }
+        else
+        {
+            outfile.write((char *)snapshot, sizeof(Snapshot));
+            if(outfile.bad() || outfile.fail())
+            {
+                fprintf(stderr, "Cpu::saveSnapshotFile() : write error in '%s'\n", filename.c_str());
+                success = false;
+            }
+        }
+
+        delete snapshot;
+        return success;
+    }
+
+    bool loadSnapshotFile(const std::string& filename)
+    {
+        std::ifstream infile(filename, std::ios::binary | std::ios::in);
+        if(!infile.is_open())
+        {
+            fprintf(stderr, "Cpu::loadSnapshotFile() : failed to open '%s'\n", filename.c_str());
+            return false;
+        }
+
+        Snapshot* snapshot = new (std::nothrow) Snapshot;
+        if(!snapshot)
+        {
+            fprintf(stderr, "Cpu::loadSnapshotFile() : out of memory!\n");
+            return false;
+        }
+
+        bool success = false;
+        infile.read((char *)snapshot, sizeof(Snapshot));
+        if(infile.bad() || infile.fail())
+        {
+            fprintf(stderr, "Cpu::loadSnapshotFile() : failed to read '%s'\n", filename.c_str());
+        }
+        else
+        {
+            success = restoreSnapshot(*snapshot);
+            if(!success) fprintf(stderr, "Cpu::loadSnapshotFile() : failed to restore '%s'\n", filename.c_str());
+        }
+
+        delete snapshot;
+        return success;
+    }
+
     void loadRom(int index)
     {
-        _romIndex = index % _numRoms;
-        memcpy(_ROM, _romFiles[_romIndex], sizeof(_ROM));
+        _emulator->_romIndex = index % _numRoms;
+        memcpy(_emulator->_ROM, _romFiles[_emulator->_romIndex], sizeof(_emulator->_ROM));
+        _emulator->_scanlineMode = ScanlineMode::Normal;
+        hashRom();
         reset(true);
+
+        // History from a different ROM can't be restored
+        if(_emulator->_hostOutput) Rewind::reset();
     }
 
     void swapRom(void)
     {
-        _romIndex = (_romIndex + 1) % _numRoms;
-        memcpy(_ROM, _romFiles[_romIndex], sizeof(_ROM));
+        loadRom(_emulator->_romIndex + 1);
+    }
+
+    // Independent instances for batch runs, each one must only be run by one thread at a time, (see setEmulator())
+    Emulator* createEmulator(int romIndex, uint32_t seed, size_t sizeRAM)
+    {
+        Emulator* emulator = new (std::nothrow) Emulator;
+        if(!emulator)
+        {
+            fprintf(stderr, "Cpu::createEmulator() : out of memory!\n");
+            return nullptr;
+        }
+
+        // Power on state comes from the instance's own generator, rand() is neither thread safe nor reproducible across threads
+        emulator->_hostOutput = false;
+        emulator->_machine._sizeRAM = uint32_t(sizeRAM);
+        garbleMachine(emulator->_machine, seed);
+
+        Emulator* current = _emulator;
+        _emulator = emulator;
+        loadRom(romIndex);
+        _emulator = current;
+
+        return emulator;
+    }
+
+    void destroyEmulator(Emulator* emulator)
+    {
+        if(emulator == &_defaultEmulator) return;
+
+        if(_emulator == emulator) _emulator = &_defaultEmulator;
+        delete emulator;
+    }
+
+    // Power on state of the current instance from a seed instead of the time, so two runs with the same seed, ROM and input are
+    // bit identical
+    void seedMachine(uint32_t seed)
+    {
+        garbleMachine(_emulator->_machine, seed);
         reset(true);
     }
 
     void shutdown(void)
     {
+#ifndef HEADLESS
+        // SDL belongs to the presenting thread, it shuts down on the caller's behalf
+        if(Graphics::stopPresenting()) return;
+#endif
+
 #ifdef _WIN32
         saveWin32Console();
 #endif
 
+        // Flushes and finalises any capture still in progress
+        Capture::stop();
+
         for(int i=NUM_INT_ROMS; i<int(_romFiles.size()); i++)
         {
             if(_romFiles[i])
@@ -562,7 +795,9 @@ namespace Cpu
             }
         }
 
+#ifndef HEADLESS
         SDL_Quit();
+#endif
     }
 
 #ifdef _WIN32
@@ -604,13 +839,14 @@ namespace Cpu
         SetConsoleCtrlHandler(consoleCtrlHandler, TRUE);
 #endif    
 
-        _RAM.resize(Memory::getSizeRAM());
+        Emulator& emu = _defaultEmulator;
 
         // Memory
         srand((unsigned int)time(NULL)); // Initialize with randomized data
-        garble((uint8_t*)_ROM, sizeof(_ROM));
-        garble(&_RAM[0], Memory::getSizeRAM());
-        garble((uint8_t*)&_stateS, sizeof(_stateS));
+        garble((uint8_t*)emu._ROM, sizeof(emu._ROM));
+        garble(emu._machine._RAM, sizeof(emu._machine._RAM));
+        garble((uint8_t*)&emu._machine._stateS, sizeof(emu._machine._stateS));
+        emu._machine._undefSeed = uint32_t(rand()) | 1;
 
         // Internal ROMS
         _romFiles.push_back(_gigatron_0x1c_rom);
@@ -623,7 +859,7 @@ namespace Cpu
         for(int i=0; i<NUM_INT_ROMS; i++) Editor::addRomEntry(types[i], names[i]);
 
         // Latest internal ROM is the one that is loaded at startup
-        _romIndex = int(_romFiles.size()) - 1;
+        emu._romIndex = int(_romFiles.size()) - 1;
 
         // External ROMS
         for(int i=0; i<Loader::getConfigRomsSize(); i++)
@@ -639,7 +875,7 @@ namespace Cpu
             else
             {
                 // Load ROM file
-                uint8_t* rom = new (std::nothrow) uint8_t[sizeof(_ROM)];
+                uint8_t* rom = new (std::nothrow) uint8_t[sizeof(emu._ROM)];
                 if(!rom)
                 {
                     // This is fairly pointless as the code does not have any exception handling for the many std:: memory allocations that occur
@@ -649,7 +885,7 @@ namespace Cpu
                     _EXIT_(EXIT_FAILURE);
                 }
 
-                file.read((char *)rom, sizeof(_ROM));
+                file.read((char *)rom, sizeof(emu._ROM));
                 if(file.bad() || file.fail())
                 {
                     fprintf(stderr, "Cpu::initialise() : failed to read ROM file : %s\n", name.c_str());
@@ -664,12 +900,16 @@ namespace Cpu
 
         // Switchable ROMS
         _numRoms = int(_romFiles.size());
-        memcpy(_ROM, _romFiles[_romIndex], sizeof(_ROM));
+        memcpy(emu._ROM, _romFiles[emu._romIndex], sizeof(emu._ROM));
+        hashRom();
+
+        // Native instruction decoder
+        decodeMicroOps();
 
 //#define CREATE_ROM_HEADER
 #ifdef CREATE_ROM_HEADER
         // Create a header file representation of a ROM, (match the ROM type number with the ROM file before enabling and running this code)
-        createRomHeader((uint8_t *)_ROM, "gigatron_0x40.h", "_gigatron_0x40_rom", sizeof(_ROM));
+        createRomHeader((uint8_t *)emu._ROM, "gigatron_0x40.h", "_gigatron_0x40_rom", sizeof(emu._ROM));
 #endif
 
 //#define CUSTOM_ROM
@@ -692,179 +932,87 @@ namespace Cpu
 #endif
 #endif
 
+#ifndef HEADLESS
         // SDL initialisation
         if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS) < 0)
         {
             fprintf(stderr, "Cpu::initialise() : failed to initialise SDL.\n");
             _EXIT_(EXIT_FAILURE);
         }
+#endif
     }
 
-    void cycle(const State& S, State& T)
+    // Specialised on the memory model, so that RAM address masking is a constant rather than a load from the machine state
+    template<uint32_t SIZE_RAM> inline void cycle(Emulator& emu, const State& S, State& T)
     {
+        uint8_t* RAM = emu._machine._RAM;
+        const uint16_t maskRAM = uint16_t(SIZE_RAM - 1);
+
         // New state is old state unless something changes
         T = S;
     
         // Instruction Fetch
-        T._IR = _ROM[S._PC][ROM_INST]; 
-        T._D  = _ROM[S._PC][ROM_DATA];
+        T._IR = emu._ROM[S._PC][ROM_INST]; 
+        T._D  = emu._ROM[S._PC][ROM_DATA];
+        T._PC = S._PC + 1;
 
         // Adapted from https://github.com/kervinck/gigatron-rom/blob/master/Contrib/dhkolf/libgtemu/gtemu.c
-        // Optimise for the statistically most common instructions
-        switch(S._IR)
+        const MicroOp& op = _microOps[S._IR];
+        switch(op._handler)
         {
-            case 0x5D: // ora [Y,X++],OUT
-            {
-                uint16_t addr = MAKE_ADDR(S._Y, S._X);
-                T._OUT = _RAM[addr & (Memory::getSizeRAM()-1)] | S._AC;
-                T._X++;
-                T._PC = S._PC + 1;
-                return;
-            }
-            break;
-
-            case 0xC2: // st [D]
-            {
-                _RAM[S._D & (Memory::getSizeRAM()-1)] = S._AC;
-                T._PC = S._PC + 1;
-                return;
-            }
-            break;
-
-            case 0x01: // ld [D]
-            {
-                T._AC = _RAM[S._D & (Memory::getSizeRAM()-1)];
-                T._PC = S._PC + 1;
-                return;
-            }
-            break;
-
-#if 0
-            case 0x00: // ld D
-            {
-                T._AC = S._D;
-                T._PC = S._PC + 1;
-                return;
-            }
-            break;
-
-            case 0x80: // adda D
-            {
-                T._AC += S._D;
-                T._PC = S._PC + 1;
-                return;
-            }
-            break;
-
-            case 0xFC: // bra D
-            {
-                T._PC = (S._PC & 0xFF00) | S._D;
-                return;
-            }
-            break;
+            case OpLdD:         T._AC = S._D;                                                     return;
+            case OpLdRamD:      T._AC = RAM[S._D & maskRAM];                                      return;
+            case OpLdRamYX:     T._AC = RAM[MAKE_ADDR(S._Y, S._X) & maskRAM];                     return;
+            case OpStRamD:      RAM[S._D & maskRAM] = S._AC;                                      return;
+            case OpOraOutYXInc: T._OUT = RAM[MAKE_ADDR(S._Y, S._X) & maskRAM] | S._AC; T._X++;    return;
+            case OpAddD:        T._AC += S._D;                                                    return;
+            case OpAddRamD:     T._AC += RAM[S._D & maskRAM];                                     return;
+            case OpSubD:        T._AC -= S._D;                                                    return;
+            case OpBraD:        T._PC = (S._PC & 0xFF00) | S._D;                                  return;
 
-            case 0x0D: // ld [Y,X]
-            {
-                uint16_t addr = MAKE_ADDR(S._Y, S._X);
-                T._AC = _RAM[addr & (Memory::getSizeRAM()-1)];
-                T._PC = S._PC + 1;
-                return;
-            }
-            break;
+            default: break;
+        }
 
-            case 0xA0: // suba D
-            {
-                T._AC -= S._D;
-                T._PC = S._PC + 1;
-                return;
-            }
-            break;
+        uint8_t lo = (op._addr & AddrX) ? S._X : S._D;
+        uint8_t hi = (op._addr & AddrYD) ? S._Y : 0;
+        uint16_t addr = (hi << 8) | lo;
 
-            case 0xE8: // blt PC,D
-            {
-                T._PC = (S._AC & 0x80) ? (S._PC & 0xFF00) | S._D : S._PC + 1;
-                return;
-            }
-            break;
+        uint8_t B = S._undef; // Data Bus
+        switch(op._bus)
+        {
+            case 0: B = S._D;                                                     break;
+            case 1: if(op._handler != OpStore) B = RAM[addr & maskRAM];           break;
+            case 2: B = S._AC;                                                    break;
+            case 3: B = emu._machine._IN;                                         break;
 
-            case 0x81: // adda [D]
-            {
-                T._AC += _RAM[S._D & (Memory::getSizeRAM()-1)];
-                T._PC = S._PC + 1;
-                return;
-            }
-            break;
+            default: break;
+        }
 
-            case 0x89: // adda [Y,D]
+        switch(op._handler)
+        {
+            // Unconditional far jump
+            case OpJump:
             {
-                uint16_t addr = MAKE_ADDR(S._Y, S._D);
-                T._AC += _RAM[addr & (Memory::getSizeRAM()-1)];
-                T._PC = S._PC + 1;
+                T._PC = (S._Y << 8) | B;
                 return;
             }
-            break;
 
-            case 0x12: // ld AC,X
+            // Conditional branch within page
+            case OpBranch:
             {
-                T._X = S._AC;
-                T._PC = S._PC + 1;
+                int cond = (S._AC>>7) + 2*(S._AC==0);
+                if(op._dest & (1 << cond)) T._PC = (S._PC & 0xff00) | B; // 74153
                 return;
             }
-            break;
 
-            case 0x18: // ld D,OUT
-            {
-                T._OUT = S._D;
-                T._PC = S._PC + 1;
-                return;
-            }
-            break;
-#endif
-            default: break;
-        }
-
-        int ins = S._IR >> 5;       // Instruction
-        int mod = (S._IR >> 2) & 7; // Addressing mode (or condition)
-        int bus = S._IR & 3;        // Busmode
-        int W = (ins == 6);         // Write instruction?
-        int J = (ins == 7);         // Jump instruction?
-    
-        uint8_t lo=S._D, hi=0, *to=NULL; // Mode Decoder
-        int incX=0;
-        if(!J)
-        {
-            switch(mod)
-            {
-                #define E(p) (W ? 0 : p) // Disable _AC and _OUT loading during _RAM write
-                case 0: to = E(&T._AC);                            break;
-                case 1: to = E(&T._AC);  lo=S._X;                  break;
-                case 2: to = E(&T._AC);           hi=S._Y;         break;
-                case 3: to = E(&T._AC);  lo=S._X; hi=S._Y;         break;
-                case 4: to =   &T._X;                              break;
-                case 5: to =   &T._Y;                              break;
-                case 6: to = E(&T._OUT);                           break;
-                case 7: to = E(&T._OUT); lo=S._X; hi=S._Y; incX=1; break;
-
-                default: break;
-            }
-        }
-
-        uint16_t addr = (hi << 8) | lo;
-        uint8_t B = S._undef; // Data Bus
-        switch(bus)
-        {
-            case 0: B=S._D;                                            break;
-            case 1: if (!W) B = _RAM[addr & (Memory::getSizeRAM()-1)]; break;
-            case 2: B=S._AC;                                           break;
-            case 3: B=_IN;                                             break;
+            // Random Access Memory
+            case OpStore: RAM[addr & maskRAM] = B; break;
 
             default: break;
         }
 
-        if(W) _RAM[addr & (Memory::getSizeRAM()-1)] = B; // Random Access Memory
-
         uint8_t ALU = 0; // Arithmetic and Logic Unit
-        switch(ins)
+        switch(op._dest >> 4)
         {
             case 0: ALU =         B; break; // LD
             case 1: ALU = S._AC & B; break; // ANDA
@@ -873,43 +1021,49 @@ namespace Cpu
             case 4: ALU = S._AC + B; break; // ADDA
             case 5: ALU = S._AC - B; break; // SUBA
             case 6: ALU = S._AC;     break; // ST
-            case 7: ALU = -S._AC;    break; // Bcc/JMP
 
             default: break;
         }
 
-        if(to) *to = ALU; // Load value into register
-        if(incX) T._X = S._X + 1; // Increment _X
+        // Load value into register
+        switch(op._dest & 0x0F)
+        {
+            case DestAC:  T._AC  = ALU; break;
+            case DestX:   T._X   = ALU; break;
+            case DestY:   T._Y   = ALU; break;
+            case DestOUT: T._OUT = ALU; break;
 
-        T._PC = S._PC + 1; // Next instruction
-        if(J)
+            default: break;
+        }
+
+        if(op._addr & 4) T._X = S._X + 1; // Increment _X
+    }
+
+    void cycle(const State& S, State& T)
+    {
+        if(_emulator->_machine._sizeRAM == RAM_SIZE_HI)
         {
-            if(mod != 0) // Conditional branch within page
-            {
-                int cond = (S._AC>>7) + 2*(S._AC==0);
-                if(mod & (1 << cond)) // 74153
-                {
-                    T._PC = (S._PC & 0xff00) | B;
-                }
-            }
-            else
-            {
-                T._PC = (S._Y << 8) | B; // Unconditional far jump
-            }
+            cycle<RAM_SIZE_HI>(*_emulator, S, T);
+            return;
         }
+
+        cycle<RAM_SIZE_LO>(*_emulator, S, T);
     }
 
     void reset(bool coldBoot)
     {
-        _coldBoot = coldBoot;
-        _checkRomType = true;
+        Machine& m = _emulator->_machine;
+        m._coldBoot = coldBoot;
+        m._checkRomType = true;
 
         clearUserRAM();
         setRAM(ZERO_CONST_ADDRESS, 0x00);
         setRAM(ONE_CONST_ADDRESS, 0x01);
         setClock(CLOCK_RESET);
 
-        Memory::initialise();
+        // Only the interactive instance has a free RAM readout, the compiler initialises it's allocator itself
+        std::lock_guard<std::recursive_mutex> lock(_sharedMutex);
+        if(_emulator->_hostOutput) Memory::setSizeFreeRAM(int(m._sizeRAM) - RAM_USED_DEFAULT);
         Graphics::resetVTable();
         Editor::setSingleStepAddress(VIDEO_Y_ADDRESS);
     }
@@ -921,173 +1075,360 @@ namespace Cpu
 
     void swapMemoryModel(void)
     {
-        (Memory::getSizeRAM() == RAM_SIZE_LO) ? Memory::setSizeRAM(RAM_SIZE_HI) : Memory::setSizeRAM(RAM_SIZE_LO);
-        _RAM.resize(Memory::getSizeRAM());
-        Memory::initialise();
+        Machine& m = _emulator->_machine;
+        m._sizeRAM = (m._sizeRAM == RAM_SIZE_LO) ? RAM_SIZE_HI : RAM_SIZE_LO;
         reset(false);
     }
 
     // Counts maximum and used vCPU instruction slots available per frame
-    void vCpuUsage(const State& S, const State& T)
+    void vCpuUsage(Emulator& emu, const State& S)
     {
-        UNREFERENCED_PARAM(T);
+        Machine& m = emu._machine;
 
         // All ROM's so far v1 through v4 use the same vCPU dispatch address!
         if(S._PC == ROM_VCPU_DISPATCH)
         {
-            _vPC = (getRAM(0x0017) <<8) | getRAM(0x0016);
-            if(_vPC < Editor::getCpuUsageAddressA()  ||  _vPC > Editor::getCpuUsageAddressB()) _vCpuInstPerFrame++;
-            _vCpuInstPerFrameMax++;
+            uint16_t vPC = (m._RAM[0x0017] <<8) | m._RAM[0x0016];
+
+            // Breakpoint or gprintf, only on arrival at a new vPC
+            if(vPC != m._vPC  &&  (_vpcTraps[vPC >> 6] >> (vPC & 63)) & 1) emu._vpcTrap = true;
+
+            m._vPC = vPC;
+            if(m._vPC < Editor::getCpuUsageAddressA()  ||  m._vPC > Editor::getCpuUsageAddressB()) m._vCpuInstPerFrame++;
+            m._vCpuInstPerFrameMax++;
 
             // Soft reset
-            if(_vPC == 0x01F0) softReset();
+            if(m._vPC == 0x01F0) softReset();
+        }
+    }
 
-            static uint64_t prevFrameCounter = 0;
-            double frameTime = double(SDL_GetPerformanceCounter() - prevFrameCounter) / double(SDL_GetPerformanceFrequency());
-            if(frameTime > VSYNC_TIMING_60)
-            {
-                // TODO: this is a bit of a hack, but it's emulation only so...
-                // Check for magic cookie that defines a CpuUsageAddressA and CpuUsageAddressB sequence
-                uint16_t magicWord0 = (getRAM(0x7F99) <<8) | getRAM(0x7F98);
-                uint16_t magicWord1 = (getRAM(0x7F9B) <<8) | getRAM(0x7F9A);
-                uint16_t cpuUsageAddressA = (getRAM(0x7F9D) <<8) | getRAM(0x7F9C);
-                uint16_t cpuUsageAddressB = (getRAM(0x7F9F) <<8) | getRAM(0x7F9E);
-                if(magicWord0 == 0xDEAD  &&  magicWord1 == 0xBEEF)
-                {
-                    Editor::setCpuUsageAddressA(cpuUsageAddressA);
-                    Editor::setCpuUsageAddressB(cpuUsageAddressB);
-                }
+    void vCpuUsage(const State& S, const State& T)
+    {
+        UNREFERENCED_PARAM(T);
 
-                prevFrameCounter = SDL_GetPerformanceCounter();
-                _vCpuUtilisation = (_vCpuInstPerFrameMax) ? float(_vCpuInstPerFrame) / float(_vCpuInstPerFrameMax) : 0.0f;
-                _vCpuInstPerFrame = 0;
-                _vCpuInstPerFrameMax = 0;
-            }
+        vCpuUsage(*_emulator, S);
+    }
+
+    // Utilisation is calculated once per emulated frame, rather than polling the host timer on every vCPU dispatch
+    void vCpuUsageFrame(Emulator& emu)
+    {
+        Machine& m = emu._machine;
+
+        // TODO: this is a bit of a hack, but it's emulation only so...
+        // Check for magic cookie that defines a CpuUsageAddressA and CpuUsageAddressB sequence
+        uint16_t magicWord0 = (getRAM(0x7F99) <<8) | getRAM(0x7F98);
+        uint16_t magicWord1 = (getRAM(0x7F9B) <<8) | getRAM(0x7F9A);
+        uint16_t cpuUsageAddressA = (getRAM(0x7F9D) <<8) | getRAM(0x7F9C);
+        uint16_t cpuUsageAddressB = (getRAM(0x7F9F) <<8) | getRAM(0x7F9E);
+        if(emu._hostOutput  &&  magicWord0 == 0xDEAD  &&  magicWord1 == 0xBEEF)
+        {
+            Editor::setCpuUsageAddressA(cpuUsageAddressA);
+            Editor::setCpuUsageAddressB(cpuUsageAddressB);
         }
+
+        m._vCpuUtilisation = (m._vCpuInstPerFrameMax) ? float(m._vCpuInstPerFrame) / float(m._vCpuInstPerFrameMax) : 0.0f;
+        m._vCpuInstPerFrame = 0;
+        m._vCpuInstPerFrameMax = 0;
     }
 
-    void process(void)
+    // MCP100 Power-On Reset
+    void powerOnReset(Emulator& emu)
     {
-        // MCP100 Power-On Reset
-        if(_clock < 0)
+        Machine& m = emu._machine;
+        m._stateS._PC = 0; 
+        m._initAudio = true;
+        m._isInReset = true;
+        Loader::setCurrentGame(std::string(""));
+    }
+
+    // Falling vSync edge
+    void processVSync(Emulator& emu)
+    {
+        Machine& m = emu._machine;
+        m._clockStall = m._clock;
+        m._vgaY = VSYNC_START;
+
+        vCpuUsageFrame(emu);
+
+        Replay::processEdge(Replay::VSyncEdge);
+        if(Profiler::getNativeEnabled()) Profiler::nativeVSync();
+        if(emu._hostOutput) Capture::captureFrame(emu._video);
+        if(emu._hostOutput  &&  !m._initAudio) Audio::playMusic();
+        if(emu._hostOutput) Audio::synthesiseFrame();
+
+        if(!emu._debugging)
         {
-            _stateS._PC = 0; 
-            _initAudio = true;
-            _isInReset = true;
-            Loader::setCurrentGame(std::string(""));
+            // Input and graphics 60 times per second
+            Editor::handleInput();
+            if(emu._hostOutput) Graphics::render(true);
+            if(emu._hostOutput) Rewind::captureFrame();
+
+            emu._singleStepping = Editor::getSingleStepping();
         }
+        else
+        {
+            // History is still recorded whilst running to a breakpoint or stepping, so stepping back from a hit lands at the start of it's
+            // frame, only a paused debugger has nothing new to record
+            if(emu._hostOutput  &&  !Editor::getSingleStepEnabled()) Rewind::captureFrame();
 
-        // Update CPU
-        cycle(_stateS, _stateT);
+            // Run to breakpoint only sees trap hits, so give the debugger's stall timeout a chance once per frame
+            emu._debugging = Editor::handleDebugger();
+            emu._singleStepping = Editor::getSingleStepping();
+        }
+    }
 
-        // vCPU instruction slot utilisation
-        vCpuUsage(_stateS, _stateT);
+    // RomType, Audio and Watchdog, these only trigger once the startup delay has passed
+    void processStartup(Emulator& emu)
+    {
+        Machine& m = emu._machine;
+        if(m._isInReset)
+        {
+            setRomType();
+            m._isInReset = false;
+        }
 
-        _hSync = (_stateT._OUT & 0x40) - (_stateS._OUT & 0x40);
-        _vSync = (_stateT._OUT & 0x80) - (_stateS._OUT & 0x80);
-    
-        // Falling vSync edge
-        if(_vSync < 0)
+        if(m._initAudio  &&  m._clock > STARTUP_DELAY_CLOCKS*10.0)
         {
-            _clockStall = _clock;
-            _vgaY = VSYNC_START;
+            Audio::initialiseChannels(m._coldBoot);
 
-            if(!_debugging)
+            m._coldBoot = false;
+            m._initAudio = false;
+        }
+
+        if(!emu._debugging  &&  m._clock - m._clockStall > CPU_STALL_CLOCKS)
+        {
+            m._clockStall = CLOCK_RESET;
+            reset(true);
+            m._vgaX = 0, m._vgaY = 0;
+            m._hSync = 0, m._vSync = 0;
+            fprintf(stderr, "Cpu::process(): CPU stall for %" PRId64 " clocks : rebooting.\n", m._clock - m._clockStall);
+        }
+    }
+
+    // Rising hSync edge
+    void processHSync(Emulator& emu)
+    {
+        Machine& m = emu._machine;
+        m._XOUT = m._stateT._AC;
+    
+        // Audio
+        //Audio::playSample();
+        //Audio::fillBuffer();
+        if(emu._hostOutput) Audio::fillCallbackBuffer();
+
+        // Loader
+        Replay::processEdge(Replay::HSyncEdge);
+        if(m._clock > STARTUP_DELAY_CLOCKS*10.0) Loader::upload(m._vgaY);
+
+        // Horizontal timing errors
+        if(m._vgaY >= 0  &&  m._vgaY < SCREEN_HEIGHT)
+        {
+            if((m._vgaY % 4) == 0) m._timingColour = 0xFF220000;
+            if(m._vgaX != 200  &&  m._vgaX != 400) // Support for 6.25Mhz and 12.5MHz
             {
-                // Input and graphics 60 times per second
-                Editor::handleInput();
-                Graphics::render(true);
+                m._timingColour = 0xFFFF0000;
+                //fprintf(stderr, "Cpu::process(): Horizontal timing error : vgaX %03d : vgaY %03d : xout %02x : time %0.3f\n", m._vgaX, m._vgaY, m._stateT._AC, float(m._clock)/float(CLOCK_FREQ));
             }
+            if(emu._hostOutput  &&  (m._vgaY % 4) == 3) Graphics::refreshTimingPixel(m._stateS, GIGA_WIDTH, m._vgaY / 4, m._timingColour, emu._debugging);
+
+            // The scanline that just finished goes to the host in one go
+            if(emu._hostOutput) Graphics::refreshScanline(emu._video[m._vgaY], m._vgaY);
         }
 
-        // Pixel
-        if(_vgaX++ < HLINE_END)
+        m._vgaX = 0;
+        m._vgaY++;
+
+        // Change this once in a while, from the machine's own generator so that runs can be replayed
+        m._undefSeed ^= m._undefSeed << 13;
+        m._undefSeed ^= m._undefSeed >> 17;
+        m._undefSeed ^= m._undefSeed << 5;
+        m._stateT._undef = uint8_t(m._undefSeed);
+    }
+
+    // Runs the vCPU at NEXT through Hle::execute() for as long as the time slice's vTicks allow, leaving the native state exactly as the
+    // ROM's interpreter would have at the NEXT after the last instruction; SYS, LUP, unknown opcodes, breakpoints, soft reset and anything
+    // that would overrun 'budget' are left to the native interpreter, returns the native cycles that were skipped
+    template<uint32_t SIZE_RAM> int64_t processHle(Emulator& emu, int64_t budget)
+    {
+        Machine& m = emu._machine;
+        uint8_t* RAM = m._RAM;
+        const uint16_t maskRAM = uint16_t(SIZE_RAM - 1);
+        Hle::InstructionSet instructionSet = (m._romType >= ROMv5a) ? Hle::vCpuV5a : Hle::vCpuV1;
+
+        int64_t cycles = 0;
+        uint8_t AC = m._stateS._AC;
+        for(;;)
         {
-            if(_vgaY >= 0  &&  _vgaY < SCREEN_HEIGHT)
+            // adda [vTicks], blt EXIT
+            uint8_t ticks = uint8_t(AC + RAM[HLE_VTICKS]);
+            if(ticks & 0x80) break;
+
+            uint16_t vPC = MAKE_ADDR(RAM[HLE_VPC + 1], RAM[HLE_VPC] + 2);
+            if(vPC == 0x01F0  ||  (vPC != m._vPC  &&  (_vpcTraps[vPC >> 6] >> (vPC & 63)) & 1)  ||  cycles + HLE_MAX_CYCLES > budget) break;
+
+            // st [vTicks] happens before the dispatch, put it back if the interpreter has to run the instruction from scratch
+            uint8_t vTicks = RAM[HLE_VTICKS];
+            RAM[HLE_VTICKS] = ticks;
+            int cost = Hle::execute(RAM, maskRAM, vPC, instructionSet);
+            if(cost == 0)
             {
-                if(_vgaX >=HPIXELS_START  &&  _vgaX < HPIXELS_END) Graphics::refreshPixel(_stateS, _vgaX-HPIXELS_START, _vgaY);
-
-                // Show pixel reticle when debugging Native code
-                //if(_debugging  &&  _vgaX >=HPIXELS_START-1  &&  _vgaX <= HPIXELS_END-1) Graphics::pixelReticle(_stateS, _vgaX-(HPIXELS_START-1), _vgaY);
+                RAM[HLE_VTICKS] = vTicks;
+                break;
             }
+
+            m._vPC = vPC;
+            if(m._vPC < Editor::getCpuUsageAddressA()  ||  m._vPC > Editor::getCpuUsageAddressB()) m._vCpuInstPerFrame++;
+            m._vCpuInstPerFrameMax++;
+
+            AC = uint8_t(-cost/2);
+            cycles += cost;
+        }
+
+        if(cycles)
+        {
+            m._stateS._AC = AC;
+            m._stateS._Y = RAM[HLE_VPC + 1];
         }
 
-#if defined(COLLECT_INST_STATS)
-        _totalCount++;
-        _instCounts[_stateT._IR]._count++;
-        _instCounts[_stateT._IR]._inst = _stateT._IR;
-        if(_clock > STARTUP_DELAY_CLOCKS * 500.0)
+        return cycles;
+    }
+
+    // The interpreter's time slice doesn't touch OUT, so the skipped clocks are the current pixel repeated, (see the pixel code below)
+    void skipHle(Emulator& emu, int64_t cycles)
+    {
+        Machine& m = emu._machine;
+        if(m._vgaY >= 0  &&  m._vgaY < SCREEN_HEIGHT)
         {
-            displayInstCounts();
-            _EXIT_(0);
+            int start = std::max(m._vgaX + 1, HPIXELS_START);
+            int end = int(std::min(int64_t(m._vgaX) + cycles, int64_t(std::min(HLINE_END, HPIXELS_END - 1))));
+            for(int vgaX=start; vgaX<=end; vgaX++) emu._video[m._vgaY][vgaX-HPIXELS_START] = m._stateS._OUT;
         }
-#endif        
 
-        // RomType and Watchdog
-        if(_clock > STARTUP_DELAY_CLOCKS)
+        m._vgaX += int(cycles);
+        m._clock += cycles;
+    }
+
+    // Runs up to 'cycles' clocks in a tight loop, returning early once any of the requested events has occurred; peripheral work only
+    // happens at the edges where it matters, so the per clock cost is the CPU itself plus a handful of compares
+    // One instantiation per memory model; returns early if the model is swapped underneath it, (swapMemoryModel(), a 64K upload or
+    // a restored snapshot), so that runUntil() can carry on in the other instantiation
+    template<uint32_t SIZE_RAM> int64_t runUntil(Emulator& emu, int64_t cycles, int events, int& occurred)
+    {
+        Machine& m = emu._machine;
+
+        int64_t count = 0;
+        bool vCpuProfile = Profiler::getVCpuEnabled();
+        uint64_t* nativeCycles = (Profiler::getNativeEnabled()) ? Profiler::getNativeCycles() : nullptr;
+        bool instructionMix = Profiler::getMixEnabled();
+        bool profiling = vCpuProfile  ||  nativeCycles  ||  instructionMix;
+
+        while(count < cycles  &&  !(occurred & events))
         {
-            if(_isInReset)
+            if(m._clock < 0) powerOnReset(emu);
+
+            // Update CPU
+            cycle<SIZE_RAM>(emu, m._stateS, m._stateT);
+            count++;
+
+            // Native cycles per PC and the instruction mix, (the instruction that executed is the one in the old state)
+            if(nativeCycles) nativeCycles[m._stateS._PC]++;
+            if(instructionMix) Profiler::mixInstruction(m._stateS._IR, m._stateS._AC);
+
+            // vCPU instruction slot utilisation
+            if(m._stateS._PC == ROM_VCPU_DISPATCH) vCpuUsage(emu, m._stateS);
+
+            // vCPU hotspots, an instruction runs from it's dispatch until the interpreter is back at NEXT
+            if(vCpuProfile)
+            {
+                if(m._stateS._PC == ROM_VCPU_DISPATCH) Profiler::vCpuDispatch(m._vPC, m._clock);
+                else if((m._stateS._PC & 0xFFFE) == ROM_VCPU_NEXTY) Profiler::vCpuNext(m._clock);
+            }
+
+            m._hSync = (m._stateT._OUT & 0x40) - (m._stateS._OUT & 0x40);
+            m._vSync = (m._stateT._OUT & 0x80) - (m._stateS._OUT & 0x80);
+    
+            bool edge = false;
+            if(m._vSync < 0)
             {
-                setRomType();
-                _isInReset = false;
+                processVSync(emu);
+                occurred |= RunVSync;
+                edge = true;
             }
 
-            if(_initAudio  &&  _clock > STARTUP_DELAY_CLOCKS*10.0)
+            // Pixel
+            if(m._vgaX++ < HLINE_END)
             {
-                Audio::initialiseChannels(_coldBoot);
+                if(m._vgaY >= 0  &&  m._vgaY < SCREEN_HEIGHT)
+                {
+                    // Captured raw, the host's copy is expanded a scanline at a time at the next rising hSync
+                    if(m._vgaX >=HPIXELS_START  &&  m._vgaX < HPIXELS_END) emu._video[m._vgaY][m._vgaX-HPIXELS_START] = m._stateS._OUT;
 
-                _coldBoot = false;
-                _initAudio = false;
+                    // Show pixel reticle when debugging Native code
+                    //if(emu._debugging  &&  m._vgaX >=HPIXELS_START-1  &&  m._vgaX <= HPIXELS_END-1) Graphics::pixelReticle(m._stateS, m._vgaX-(HPIXELS_START-1), m._vgaY);
+                }
             }
 
-            if(!_debugging  &&  _clock - _clockStall > CPU_STALL_CLOCKS)
+            if(m._clock > STARTUP_DELAY_CLOCKS  &&  (m._isInReset  ||  m._initAudio  ||  (!emu._debugging  &&  m._clock - m._clockStall > CPU_STALL_CLOCKS))) processStartup(emu);
+
+            if(m._hSync > 0)
             {
-                _clockStall = CLOCK_RESET;
-                reset(true);
-                _vgaX = 0, _vgaY = 0;
-                _hSync = 0, _vSync = 0;
-                fprintf(stderr, "Cpu::process(): CPU stall for %" PRId64 " clocks : rebooting.\n", _clock - _clockStall);
+                processHSync(emu);
+                occurred |= RunHSync;
+                edge = true;
             }
-        }
 
-        // Rising hSync edge
-        if(_hSync > 0)
-        {
-            _XOUT = _stateT._AC;
-        
-            // Audio
-            //Audio::playSample();
-            //Audio::fillBuffer();
-            Audio::fillCallbackBuffer();
+            // Debugger, only on a breakpoint or gprintf hit or while single stepping
+            if(emu._singleStepping  ||  emu._vpcTrap  ||  (_ntvTraps[m._stateS._PC >> 6] >> (m._stateS._PC & 63)) & 1)
+            {
+                emu._debugging = Editor::handleDebugger(emu._vpcTrap);
+                emu._singleStepping = Editor::getSingleStepping();
+                emu._vpcTrap = false;
+                if(emu._debugging) occurred |= RunBreak;
+                edge = true;
+            }
 
-            // Loader
-            if(_clock > STARTUP_DELAY_CLOCKS*10.0) Loader::upload(_vgaY);
+            // vCPU high level emulation takes over from the NEXT that is about to execute, only once the machine is up and running
+            bool hle = emu._vCpuHle  &&  m._stateS._PC == ROM_VCPU_NEXT  &&  !emu._debugging  &&  !emu._singleStepping;
 
-            // Horizontal timing errors
-            if(_vgaY >= 0  &&  _vgaY < SCREEN_HEIGHT)
+            m._stateS = m._stateT;
+            m._clock++;
+
+            if(edge  &&  m._sizeRAM != SIZE_RAM) break;
+
+            if(hle  &&  !profiling  &&  !m._isInReset  &&  !m._initAudio  &&  m._romType != ROMERR)
             {
-                static uint32_t colour = 0xFF220000;
-                if((_vgaY % 4) == 0) colour = 0xFF220000;
-                if(_vgaX != 200  &&  _vgaX != 400) // Support for 6.25Mhz and 12.5MHz
-                {
-                    colour = 0xFFFF0000;
-                    //fprintf(stderr, "Cpu::process(): Horizontal timing error : vgaX %03d : vgaY %03d : xout %02x : time %0.3f\n", _vgaX, _vgaY, _stateT._AC, float(_clock)/float(CLOCK_FREQ));
-                }
-                if((_vgaY % 4) == 3) Graphics::refreshTimingPixel(_stateS, GIGA_WIDTH, _vgaY / 4, colour, _debugging);
+                int64_t skipped = processHle<SIZE_RAM>(emu, cycles - count);
+                if(skipped) skipHle(emu, skipped);
+                count += skipped;
             }
+        }
 
-            _vgaX = 0;
-            _vgaY++;
+        return count;
+    }
+
+    int64_t runUntil(int64_t cycles, int events)
+    {
+        Emulator& emu = *_emulator;
+
+        int64_t count = 0;
+        int occurred = RunNone;
+        while(count < cycles  &&  !(occurred & events))
+        {
+            if(emu._machine._sizeRAM == RAM_SIZE_HI)
+            {
+                count += runUntil<RAM_SIZE_HI>(emu, cycles - count, events, occurred);
+                continue;
+            }
 
-            // Change this once in a while
-            _stateT._undef = rand() & 0xff;
+            count += runUntil<RAM_SIZE_LO>(emu, cycles - count, events, occurred);
         }
 
-        // Debugger
-        _debugging = Editor::handleDebugger();
+        return count;
+    }
 
-        _stateS = _stateT;
-        _clock++;
+    void process(void)
+    {
+        runUntil(1);
     }
 
 #ifdef _WIN32
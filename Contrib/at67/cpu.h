@@ -6,6 +6,10 @@
 #include <map>
 #include <string>
 #include <algorithm>
+#include <mutex>
+
+#include "memory.h"
+#include "loader.h"
 
 
 #define MAJOR_VERSION "0.9"
@@ -34,8 +38,22 @@
 
 #define ROM_TYPE          0x0021
 #define ROM_TYPE_MASK     0x00FC
+#define ROM_VCPU_NEXTY    0x0300
+#define ROM_VCPU_NEXT     0x0301
 #define ROM_VCPU_DISPATCH 0x0309
 
+// ROMv1's scanline mode code, patched by swapScanlineMode()
+#define ROM_SCANLINES_START 0x01C2
+#define ROM_SCANLINES_END   0x01DE
+#define ROM_SCANLINES_SIZE  (ROM_SCANLINES_END - ROM_SCANLINES_START + 1)
+
+// Raw OUT bytes of the visible VGA lines, (GIGA_WIDTH x SCREEN_HEIGHT)
+#define VIDEO_OUT_WIDTH  160
+#define VIDEO_OUT_HEIGHT 480
+
+#define SNAPSHOT_IDENTIFIER "GTSNAP"
+#define SNAPSHOT_VERSION    2
+
 #if defined(_WIN32)
 #define _EXIT_(f)       \
     do                  \
@@ -74,6 +92,7 @@ namespace Cpu
     enum ScanlineMode {Normal=0, VideoB, VideoC, VideoBC, NumScanlineModes};
     enum InternalGt1Id {SnakeGt1=0, RacerGt1=1, MandelbrotGt1=2, PicturesGt1=3, CreditsGt1=4, LoaderGt1=5, NumInternalGt1s};
     enum Endianness {LittleEndian = 0x03020100ul, BigEndian = 0x00010203ul};
+    enum RunEvent {RunNone=0x00, RunHSync=0x01, RunVSync=0x02, RunBreak=0x04};
 
     struct State
     {
@@ -81,6 +100,64 @@ namespace Cpu
         uint8_t _IR, _D, _AC, _X, _Y, _OUT, _undef;
     };
 
+    // Everything that changes as the machine runs, plain data with no pointers so that it can be copied, compared and saved as one block
+    struct Machine
+    {
+        State _stateS, _stateT;
+        int64_t _clock = CLOCK_RESET;
+        int64_t _clockStall = CLOCK_RESET;
+        int _vgaX = 0, _vgaY = 0;
+        int _hSync = 0, _vSync = 0;
+        uint8_t _IN = 0xFF, _XOUT = 0x00;
+        uint16_t _vPC = 0x0200;
+        int _vCpuInstPerFrame = 0;
+        int _vCpuInstPerFrameMax = 0;
+        float _vCpuUtilisation = 0.0f;
+        uint32_t _timingColour = 0xFF220000;
+        bool _coldBoot = true;
+        bool _isInReset = false;
+        bool _checkRomType = true;
+        bool _initAudio = true;
+        RomType _romType = ROMERR;
+        uint32_t _sizeRAM = RAM_SIZE_LO;
+        Loader::UploadState _upload;
+        uint32_t _undefSeed = 0x2545F491; // xorshift32 state for the undefined data bus value, never zero
+        uint8_t _waveTables[256];
+        uint8_t _RAM[RAM_SIZE_HI];
+    };
+
+    // One complete Gigatron, the free functions below operate on the calling thread's current instance, (see setEmulator())
+    struct Emulator
+    {
+        Machine _machine;
+        int _romIndex = 0;
+        bool _hostOutput = true; // feeds the host's display and audio, only the interactive instance does this
+        bool _debugging = false;
+        bool _singleStepping = false;
+        bool _vpcTrap = false;
+        bool _vCpuHle = false; // vCPU instructions are run by Hle::execute() rather than the ROM's interpreter, see runUntil()
+        int _scanlineMode = ScanlineMode::Normal;
+        uint8_t _scanlinesROM[ROM_SCANLINES_SIZE][2]; // unpatched copy of ROMv1's scanline mode code
+        uint64_t _romHash = 0; // of the ROM image as loaded, before setRomType() and the scanline modes patch it, see hashRom()
+        uint8_t _ROM[ROM_SIZE][2];
+        uint8_t _video[VIDEO_OUT_HEIGHT][VIDEO_OUT_WIDTH];
+    };
+
+    // Snapshots are the Machine block as is, so they are only valid for the same build layout, host endianness and ROM contents
+    struct SnapshotHeader
+    {
+        char _name[7] = SNAPSHOT_IDENTIFIER;
+        uint8_t _version = SNAPSHOT_VERSION;
+        uint32_t _endianness = 0;
+        uint32_t _machineSize = 0;
+        uint64_t _romHash = 0;
+    };
+    struct Snapshot
+    {
+        SnapshotHeader _header;
+        Machine _machine;
+    };
+
     struct InternalGt1
     {
         uint16_t _start;
@@ -90,10 +167,14 @@ namespace Cpu
     };
 
 
+    Emulator* getEmulator(void);
+    void setEmulator(Emulator* emulator);
+
     int getNumRoms(void);
     int getRomIndex(void);
 
     uint8_t* getPtrToROM(int& romSize);
+    uint8_t* getPtrToRAM(int& ramSize);
     RomType getRomType(void);
     std::map<std::string, RomType>& getRomTypeMap(void);
     bool getRomTypeStr(RomType romType, std::string& romTypeStr);
@@ -116,6 +197,11 @@ namespace Cpu
     bool patchSplitGt1IntoRom(const std::string& splitGt1path, const std::string& splitGt1name, uint16_t startAddress, InternalGt1Id gt1Id);
 
 #ifndef STAND_ALONE
+    std::recursive_mutex& getSharedMutex(void);
+
+    Emulator* createEmulator(int romIndex, uint32_t seed, size_t sizeRAM=RAM_SIZE_LO);
+    void destroyEmulator(Emulator* emulator);
+
     bool getColdBoot(void);
     bool getIsInReset(void);
     State& getStateS(void);
@@ -124,11 +210,13 @@ namespace Cpu
     uint8_t getIN(void);
     uint8_t getXOUT(void);
     uint16_t getVPC(void);
+    int getSizeRAM(void);
     uint8_t getRAM(uint16_t address);
     uint8_t getROM(uint16_t address, int page);
     uint16_t getRAM16(uint16_t address);
     uint16_t getROM16(uint16_t address, int page);
     float getvCpuUtilisation(void);
+    bool getVCpuHle(void);
 
     void setColdBoot(bool coldBoot);
     void setIsInReset(bool isInReset);
@@ -141,11 +229,20 @@ namespace Cpu
     void setROM16(uint16_t base, uint16_t address, uint16_t data);
     void setRomType(void);
     void setSizeRAM(size_t size);
+    void setVCpuHle(bool vCpuHle);
 
     void saveScanlineModes(void);
     void restoreScanlineModes(void);
     void swapScanlineMode(void);
 
+    uint64_t getRomHash(void);
+    void hashRom(void);
+    void takeSnapshot(Snapshot& snapshot);
+    bool restoreSnapshot(const Snapshot& snapshot);
+    bool saveSnapshotFile(const std::string& filename);
+    bool loadSnapshotFile(const std::string& filename);
+    void seedMachine(uint32_t seed);
+
     void loadRom(int index);
     void swapRom(void);
 
@@ -156,6 +253,7 @@ namespace Cpu
     void softReset(void);
     void swapMemoryModel(void);
     void vCpuUsage(const State& S, const State& T);
+    int64_t runUntil(int64_t cycles, int events=RunNone);
     void process(void);
 
 #ifdef _WIN32
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include <vector>
 #include <algorithm>
 #include <sys/stat.h>
@@ -16,6 +17,9 @@
 #include <SDL.h>
 #include "memory.h"
 #include "cpu.h"
+#include "rewind.h"
+#include "profiler.h"
+#include "capture.h"
 #include "audio.h"
 #include "editor.h"
 #include "loader.h"
@@ -83,6 +87,11 @@ namespace Editor
     
     std::vector<uint16_t> _ntvBreakPoints;
     std::vector<uint16_t> _vpcBreakPoints;
+    std::vector<uint16_t> _gprintfTraps;
+
+    // One bit per address for native breakpoints and for vPC breakpoints plus gprintfs, the emulator only calls handleDebugger() on a hit
+    uint64_t _ntvTraps[0x10000 / 64];
+    uint64_t _vpcTraps[0x10000 / 64];
 
     int _fileEntriesSize = 0;
     int _fileEntriesIndex = 0;
@@ -104,6 +113,8 @@ namespace Editor
     int getCursorY(void) {return _cursorY;}
     bool getHexEdit(void) {return _hexEdit;}
     bool getSingleStepEnabled(void) {return _singleStepEnabled;}
+    const uint64_t* getNtvTraps(void) {return _ntvTraps;}
+    const uint64_t* getVpcTraps(void) {return _vpcTraps;}
     bool getStartMusic(void) {return _startMusic;}
 
     bool getPageUpButton(void) {return _pageUpButton;}
@@ -126,15 +137,38 @@ namespace Editor
     uint16_t getCpuUsageAddressA(void) {return _cpuUsageAddressA;}
     uint16_t getCpuUsageAddressB(void) {return _cpuUsageAddressB;}
 
+    void updateTraps(void)
+    {
+        memset(_ntvTraps, 0, sizeof(_ntvTraps));
+        memset(_vpcTraps, 0, sizeof(_vpcTraps));
+
+        for(int i=0; i<int(_ntvBreakPoints.size()); i++) _ntvTraps[_ntvBreakPoints[i] >> 6] |= 1ull << (_ntvBreakPoints[i] & 63);
+        for(int i=0; i<int(_vpcBreakPoints.size()); i++) _vpcTraps[_vpcBreakPoints[i] >> 6] |= 1ull << (_vpcBreakPoints[i] & 63);
+        for(int i=0; i<int(_gprintfTraps.size()); i++) _vpcTraps[_gprintfTraps[i] >> 6] |= 1ull << (_gprintfTraps[i] & 63);
+    }
+
     int getNtvBreakPointsSize(void) {return int(_ntvBreakPoints.size());}
     uint16_t getNtvBreakPointAddress(int index) {return _ntvBreakPoints.size() ? _ntvBreakPoints[index % _ntvBreakPoints.size()] : 0;}
-    void addNtvBreakPoint(uint16_t address) {_ntvBreakPoints.push_back(address);}
-    void clearNtvBreakPoints(void) {_ntvBreakPoints.clear();}
+    void addNtvBreakPoint(uint16_t address) {_ntvBreakPoints.push_back(address); updateTraps();}
+    void clearNtvBreakPoints(void) {_ntvBreakPoints.clear(); updateTraps();}
 
     int getVpcBreakPointsSize(void) {return int(_vpcBreakPoints.size());}
     uint16_t getVpcBreakPointAddress(int index) {return _vpcBreakPoints.size() ? _vpcBreakPoints[index % _vpcBreakPoints.size()] : 0;}
-    void addVpcBreakPoint(uint16_t address) {_vpcBreakPoints.push_back(address);}
-    void clearVpcBreakPoints(void) {_vpcBreakPoints.clear();}
+    void addVpcBreakPoint(uint16_t address) {_vpcBreakPoints.push_back(address); updateTraps();}
+    void clearVpcBreakPoints(void) {_vpcBreakPoints.clear(); updateTraps();}
+
+    void addGprintfTrap(uint16_t address) {_gprintfTraps.push_back(address); updateTraps();}
+    void clearGprintfTraps(void) {_gprintfTraps.clear(); updateTraps();}
+
+    // Paused, single stepping or watching a variable needs every clock, run to breakpoint only needs trap hits unless there are no breakpoints to run to
+    bool getSingleStepping(void)
+    {
+        if(_singleStepEnabled) return true;
+        if(!_singleStep) return false;
+        if(_singleStepMode != RunToBrk) return true;
+
+        return (_memoryMode == RAM) ? _vpcBreakPoints.empty() : _ntvBreakPoints.empty();
+    }
 
     int getFileEntriesIndex(void) {return _fileEntriesIndex;}
     int getFileEntriesSize(void) {return int(_fileEntries.size());}
@@ -407,6 +441,11 @@ namespace Editor
         _emulator["Terminal"]     = {SDLK_t, KMOD_LCTRL};
         _emulator["ImageEditor"]  = {SDLK_i, KMOD_LCTRL};
         _emulator["ScanlineMode"] = {SDLK_s, KMOD_LCTRL};
+        _emulator["Profile"]      = {SDLK_p, KMOD_LCTRL};
+        _emulator["InstMix"]      = {SDLK_j, KMOD_LCTRL};
+        _emulator["FastForward"]  = {SDLK_f, KMOD_LCTRL};
+        _emulator["Turbo"]        = {SDLK_u, KMOD_LCTRL};
+        _emulator["Capture"]      = {SDLK_v, KMOD_LCTRL};
         _emulator["Reset"]        = {SDLK_F1, KMOD_LCTRL};
         _emulator["Help"]         = {SDLK_h, KMOD_LCTRL};
         _emulator["Quit"]         = {SDLK_q, KMOD_LCTRL};
@@ -426,6 +465,7 @@ namespace Editor
         _hardware["Reset"]   = {SDLK_F2, KMOD_LCTRL};
 
         // Debugger INI key to SDL key mapping
+        _debugger["StepBack"]  = {SDLK_F5, KMOD_LCTRL};
         _debugger["Debug"]     = {SDLK_F6, KMOD_LCTRL};
         _debugger["RunToBrk"]  = {SDLK_F7, KMOD_LCTRL};
         _debugger["StepPC"]    = {SDLK_F8, KMOD_LCTRL};
@@ -468,6 +508,11 @@ namespace Editor
                     scanCodeFromIniKey(sectionString, "Terminal",     "CTRL+T",   _emulator["Terminal"]);
                     scanCodeFromIniKey(sectionString, "ImageEditor",  "CTRL+I",   _emulator["ImageEditor"]);
                     scanCodeFromIniKey(sectionString, "ScanlineMode", "CTRL+S",   _emulator["ScanlineMode"]);
+                    scanCodeFromIniKey(sectionString, "Profile",      "CTRL+P",   _emulator["Profile"]);
+                    scanCodeFromIniKey(sectionString, "InstMix",      "CTRL+J",   _emulator["InstMix"]);
+                    scanCodeFromIniKey(sectionString, "FastForward",  "CTRL+F",   _emulator["FastForward"]);
+                    scanCodeFromIniKey(sectionString, "Turbo",        "CTRL+U",   _emulator["Turbo"]);
+                    scanCodeFromIniKey(sectionString, "Capture",      "CTRL+V",   _emulator["Capture"]);
                     scanCodeFromIniKey(sectionString, "Reset",        "CTRL+F1",  _emulator["Reset"]);
                     scanCodeFromIniKey(sectionString, "Help",         "CTRL+H",   _emulator["Help"]);
                     scanCodeFromIniKey(sectionString, "Quit",         "CTRL+Q",   _emulator["Quit"]);
@@ -496,6 +541,7 @@ namespace Editor
 
                 case Debugger:
                 {
+                    scanCodeFromIniKey(sectionString, "StepBack",  "CTRL+F5", _debugger["StepBack"]);
                     scanCodeFromIniKey(sectionString, "Debug",     "CTRL+F6", _debugger["Debug"]);
                     scanCodeFromIniKey(sectionString, "RunToBrk",  "CTRL+F7", _debugger["RunToBrk"]);
                     scanCodeFromIniKey(sectionString, "StepPC",    "CTRL+F8", _debugger["StepPC"]);
@@ -592,7 +638,7 @@ namespace Editor
     {
         switch(_editorMode)
         {
-            case Hex:  _hexBaseAddress = (_hexBaseAddress - HEX_CHARS_X*numRows) & (Memory::getSizeRAM()-1); break;
+            case Hex:  _hexBaseAddress = (_hexBaseAddress - HEX_CHARS_X*numRows) & (Cpu::getSizeRAM()-1); break;
             case Load: if((_fileEntriesIndex -= numRows) < 0) _fileEntriesIndex = 0;                         break;
             case Rom:  if((_romEntriesIndex -= numRows) < 0) _romEntriesIndex = 0;                           break;
 
@@ -602,22 +648,22 @@ namespace Editor
                 {
                     if(_memoryMode == RAM)
                     {
-                        _vpcBaseAddress = uint16_t(_vpcBaseAddress - Assembler::getPrevDasmByteCount()) & (Memory::getSizeRAM()-1);
+                        _vpcBaseAddress = uint16_t(_vpcBaseAddress - Assembler::getPrevDasmByteCount()) & (Cpu::getSizeRAM()-1);
                     }
                     else
                     {
-                        _ntvBaseAddress = uint16_t(_ntvBaseAddress - Assembler::getPrevDasmByteCount()) & (Memory::getSizeRAM()-1);
+                        _ntvBaseAddress = uint16_t(_ntvBaseAddress - Assembler::getPrevDasmByteCount()) & (Cpu::getSizeRAM()-1);
                     }
                 }
                 else
                 {
                     if(_memoryMode == RAM)
                     {
-                        _vpcBaseAddress = uint16_t(_vpcBaseAddress - Assembler::getPrevDasmPageByteCount()) & (Memory::getSizeRAM()-1);
+                        _vpcBaseAddress = uint16_t(_vpcBaseAddress - Assembler::getPrevDasmPageByteCount()) & (Cpu::getSizeRAM()-1);
                     }
                     else
                     {
-                        _ntvBaseAddress = uint16_t(_ntvBaseAddress - Assembler::getPrevDasmPageByteCount()) & (Memory::getSizeRAM()-1);
+                        _ntvBaseAddress = uint16_t(_ntvBaseAddress - Assembler::getPrevDasmPageByteCount()) & (Cpu::getSizeRAM()-1);
                     }
                 }
             }
@@ -631,7 +677,7 @@ namespace Editor
     {
         switch(_editorMode)
         {
-            case Hex:  _hexBaseAddress = (_hexBaseAddress + HEX_CHARS_X*numRows) & (Memory::getSizeRAM()-1); break;
+            case Hex:  _hexBaseAddress = (_hexBaseAddress + HEX_CHARS_X*numRows) & (Cpu::getSizeRAM()-1); break;
 
             case Load:
             {
@@ -661,22 +707,22 @@ namespace Editor
                 {
                     if(_memoryMode == RAM)
                     {
-                        _vpcBaseAddress = uint16_t(_vpcBaseAddress + Assembler::getCurrDasmByteCount()) & (Memory::getSizeRAM()-1);
+                        _vpcBaseAddress = uint16_t(_vpcBaseAddress + Assembler::getCurrDasmByteCount()) & (Cpu::getSizeRAM()-1);
                     }
                     else
                     {
-                        _ntvBaseAddress = uint16_t(_ntvBaseAddress + Assembler::getCurrDasmByteCount()) & (Memory::getSizeRAM()-1);
+                        _ntvBaseAddress = uint16_t(_ntvBaseAddress + Assembler::getCurrDasmByteCount()) & (Cpu::getSizeRAM()-1);
                     }
                 }
                 else
                 {
                     if(_memoryMode == RAM)
                     {
-                        _vpcBaseAddress = uint16_t(_vpcBaseAddress + Assembler::getCurrDasmPageByteCount()) & (Memory::getSizeRAM()-1);
+                        _vpcBaseAddress = uint16_t(_vpcBaseAddress + Assembler::getCurrDasmPageByteCount()) & (Cpu::getSizeRAM()-1);
                     }
                     else
                     {
-                        _ntvBaseAddress = uint16_t(_ntvBaseAddress + Assembler::getCurrDasmPageByteCount()) & (Memory::getSizeRAM()-1);
+                        _ntvBaseAddress = uint16_t(_ntvBaseAddress + Assembler::getCurrDasmPageByteCount()) & (Cpu::getSizeRAM()-1);
                     }
                 }
             }
@@ -749,6 +795,8 @@ namespace Editor
                     _ntvBreakPoints.push_back(Assembler::getDisassembledCode(_cursorY)->_address);
                 }
             }
+
+            updateTraps();
         }
     }
 
@@ -1133,6 +1181,74 @@ namespace Editor
             if(Cpu::getRomType() != Cpu::ROMv1) {Cpu::setIN(Cpu::getIN() & ~INPUT_SELECT); return;}
         }
 
+        // vCPU and native profilers, reports are written when they are turned off
+        else if(_sdlKeyScanCode == _emulator["Profile"]._scanCode  &&  _sdlKeyModifier == _emulator["Profile"]._keyMod)
+        {
+            if(!Profiler::getVCpuEnabled())
+            {
+                Profiler::setVCpuEnabled(true);
+                Profiler::resetVCpu();
+                Profiler::setNativeEnabled(true);
+                Profiler::resetNative();
+                Profiler::loadNativeSymbols();
+                fprintf(stderr, "Editor::handleKeyDown() : profiling started\n");
+                return;
+            }
+
+            Profiler::setVCpuEnabled(false);
+            Profiler::setNativeEnabled(false);
+            if(Profiler::saveVCpuReport(VCPU_PROFILE_REPORT)  &&  Profiler::saveVCpuFolded(VCPU_PROFILE_FOLDED)  &&  Profiler::saveNativeReport(NATIVE_PROFILE_REPORT))
+            {
+                fprintf(stderr, "Editor::handleKeyDown() : profiling stopped : saved '%s', '%s' and '%s'\n", VCPU_PROFILE_REPORT, VCPU_PROFILE_FOLDED, NATIVE_PROFILE_REPORT);
+            }
+            return;
+        }
+
+        // Native instruction mix, counters are reset when it is turned on and saved when it is turned off
+        else if(_sdlKeyScanCode == _emulator["InstMix"]._scanCode  &&  _sdlKeyModifier == _emulator["InstMix"]._keyMod)
+        {
+            if(!Profiler::getMixEnabled())
+            {
+                Profiler::resetMix();
+                Profiler::setMixEnabled(true);
+                fprintf(stderr, "Editor::handleKeyDown() : instruction mix started\n");
+                return;
+            }
+
+            Profiler::setMixEnabled(false);
+            if(Profiler::saveMixJson(INSTRUCTION_MIX_JSON)) fprintf(stderr, "Editor::handleKeyDown() : instruction mix stopped : saved '%s'\n", INSTRUCTION_MIX_JSON);
+            return;
+        }
+
+        // vCPU high level emulation, SYS calls and anything else it doesn't know still go through the ROM's interpreter
+        else if(_sdlKeyScanCode == _emulator["FastForward"]._scanCode  &&  _sdlKeyModifier == _emulator["FastForward"]._keyMod)
+        {
+            Cpu::setVCpuHle(!Cpu::getVCpuHle());
+            fprintf(stderr, "Editor::handleKeyDown() : vCPU high level emulation %s\n", (Cpu::getVCpuHle()) ? "on" : "off");
+            return;
+        }
+
+        // Turbo, emulation is unthrottled, frames are skipped to the host's refresh rate and audio is muted
+        else if(_sdlKeyScanCode == _emulator["Turbo"]._scanCode  &&  _sdlKeyModifier == _emulator["Turbo"]._keyMod)
+        {
+            Timing::setTurbo(!Timing::getTurbo());
+            fprintf(stderr, "Editor::handleKeyDown() : turbo %s\n", (Timing::getTurbo()) ? "on" : "off");
+            return;
+        }
+
+        // Video and audio capture, written by a background thread
+        else if(_sdlKeyScanCode == _emulator["Capture"]._scanCode  &&  _sdlKeyModifier == _emulator["Capture"]._keyMod)
+        {
+            if(Capture::getEnabled())
+            {
+                if(Capture::stop()) fprintf(stderr, "Editor::handleKeyDown() : capture stopped : saved '%s' and '%s'\n", CAPTURE_VIDEO, CAPTURE_AUDIO);
+                return;
+            }
+
+            if(Capture::start(CAPTURE_VIDEO, CAPTURE_AUDIO)) fprintf(stderr, "Editor::handleKeyDown() : capture started\n");
+            return;
+        }
+
         // PS2 Keyboard emulation mode
         else if(handlePs2KeyDown()) return;
 
@@ -1379,10 +1495,10 @@ namespace Editor
     }
 
     // Debug mode, handles it's own input and rendering
-    bool handleDebugger(void)
+    bool handleDebugger(bool vpcTrap)
     {
-        // Gprintfs
-        Assembler::printGprintfStrings();
+        // Gprintfs, only on arrival at a new vPC that has a trap
+        if(vpcTrap) Assembler::printGprintfStrings(Cpu::getVPC());
 
         // Debug
         static uint16_t vPC = Cpu::getVPC();
@@ -1429,8 +1545,9 @@ namespace Editor
                     default: break;
                 }
             }
-            // vCPU debugging, (this code can potentially run for every Native instruction, for efficiency we check vPC so this code only runs for each vCPU instruction)
-            else if(vPC != Cpu::getVPC()  ||  clocks >= MAX_SINGLE_STEP_CLOCKS)
+            // vCPU debugging, (this code can potentially run for every Native instruction, for efficiency we check vPC so this code only runs for each vCPU instruction),
+            // a trap is always a fresh arrival at it's vPC, even when the last call was at the same vPC an iteration of a loop ago
+            else if(vpcTrap  ||  vPC != Cpu::getVPC()  ||  clocks >= MAX_SINGLE_STEP_CLOCKS)
             {
                 vPC = Cpu::getVPC();
 
@@ -1502,11 +1619,11 @@ namespace Editor
             }
 
             SDL_Event event;
-            while(SDL_PollEvent(&event))
+            while(Graphics::pollEvent(event))
             {
                 _sdlKeyScanCode = event.key.keysym.sym;
                 _sdlKeyModifier = event.key.keysym.mod & (KMOD_LCTRL | KMOD_LALT);
-                _mouseState._state = SDL_GetMouseState(&_mouseState._x, &_mouseState._y);
+                _mouseState._state = Graphics::getMouseState(&_mouseState._x, &_mouseState._y);
 
                 handleGuiEvents(event);
 
@@ -1516,8 +1633,8 @@ namespace Editor
                     {
                         if(_pageUpButton  &&  event.button.button == SDL_BUTTON_LEFT) handlePageUp(HEX_CHARS_Y);
                         else if(_pageDnButton  &&  event.button.button == SDL_BUTTON_LEFT) handlePageDown(HEX_CHARS_Y);
-                        else if(_memoryMode == RAM  &&  _delAllButton  &&  event.button.button == SDL_BUTTON_LEFT) _vpcBreakPoints.clear();
-                        else if(_memoryMode != RAM  &&  _delAllButton  &&  event.button.button == SDL_BUTTON_LEFT) _ntvBreakPoints.clear();
+                        else if(_memoryMode == RAM  &&  _delAllButton  &&  event.button.button == SDL_BUTTON_LEFT) clearVpcBreakPoints();
+                        else if(_memoryMode != RAM  &&  _delAllButton  &&  event.button.button == SDL_BUTTON_LEFT) clearNtvBreakPoints();
                         else if(event.button.button == SDL_BUTTON_LEFT) handleMouseLeftClick();
                     }
                     break;
@@ -1572,6 +1689,11 @@ namespace Editor
                             _singleStepVpc = Cpu::getRAM(_singleStepAddress);
                             _singleStepNtv = Cpu::getRAM(_singleStepAddress);
                         }
+                        // Step back a frame through the rewind history
+                        else if(_sdlKeyScanCode == _debugger["StepBack"]._scanCode  &&  _sdlKeyModifier == _debugger["StepBack"]._keyMod)
+                        {
+                            if(!Rewind::stepBack()) fprintf(stderr, "Editor::handleDebugger() : no more rewind history\n");
+                        }
                         else
                         {
                             handleKeyDown();
@@ -1603,11 +1725,11 @@ namespace Editor
         _onVarType = updateOnVarType();
 
         SDL_Event event;
-        while(SDL_PollEvent(&event))
+        while(Graphics::pollEvent(event))
         {
             _sdlKeyScanCode = event.key.keysym.sym;
             _sdlKeyModifier = event.key.keysym.mod & (KMOD_LCTRL | KMOD_LALT);
-            _mouseState._state = SDL_GetMouseState(&_mouseState._x, &_mouseState._y);
+            _mouseState._state = Graphics::getMouseState(&_mouseState._x, &_mouseState._y);
 
             handleGuiEvents(event);
 
@@ -1617,8 +1739,8 @@ namespace Editor
                 {
                     if(_pageUpButton  &&  event.button.button == SDL_BUTTON_LEFT) handlePageUp(HEX_CHARS_Y);
                     else if(_pageDnButton  &&  event.button.button == SDL_BUTTON_LEFT) handlePageDown(HEX_CHARS_Y);
-                    else if(_memoryMode == RAM  &&  _delAllButton  &&  event.button.button == SDL_BUTTON_LEFT) _vpcBreakPoints.clear();
-                    else if(_memoryMode != RAM  &&  _delAllButton  &&  event.button.button == SDL_BUTTON_LEFT) _ntvBreakPoints.clear();
+                    else if(_memoryMode == RAM  &&  _delAllButton  &&  event.button.button == SDL_BUTTON_LEFT) clearVpcBreakPoints();
+                    else if(_memoryMode != RAM  &&  _delAllButton  &&  event.button.button == SDL_BUTTON_LEFT) clearNtvBreakPoints();
                     else if(event.button.button == SDL_BUTTON_LEFT) handleMouseLeftClick();
                     else if(event.button.button == SDL_BUTTON_RIGHT) handleMouseRightClick();
                 }
@@ -1635,18 +1757,8 @@ namespace Editor
 
         if(_keyboardMode == PS2)
         {
-            int numKeys;
-            const Uint8 *keyboardState = SDL_GetKeyboardState(&numKeys);
-            bool anyKeyPressed = false;
+            bool anyKeyPressed = Graphics::getAnyKeyPressed();
             static bool anyKeyPressedPrev = anyKeyPressed;
-            for(int i=0; i<numKeys; i++)
-            {
-                if(keyboardState[i])
-                { 
-                    anyKeyPressed = true;
-                    break;
-                }
-            }
             if(anyKeyPressedPrev  &&  !anyKeyPressed) Cpu::setIN(0xFF);
             anyKeyPressedPrev = anyKeyPressed;
         }
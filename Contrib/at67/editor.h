@@ -4,7 +4,7 @@
 #include <stdint.h>
 #include <string>
 
-#ifndef STAND_ALONE
+#if !defined(STAND_ALONE)  &&  !defined(HEADLESS)
 #include <SDL.h>
 #endif
 
@@ -48,7 +48,7 @@ namespace Editor
     enum FileType {File=0, Dir, Fifo, Link, NumFileTypes};
     enum OnVarType {OnNone=0, OnCpuA, OnCpuB, OnHex, OnVars, OnWatch, NumOnVarTypes};
 
-#ifndef STAND_ALONE
+#if !defined(STAND_ALONE)  &&  !defined(HEADLESS)
     struct KeyCodeMod
     {
         int _scanCode;
@@ -73,6 +73,9 @@ namespace Editor
     int getCursorY(void);
     bool getHexEdit(void);
     bool getSingleStepEnabled(void);
+    bool getSingleStepping(void);
+    const uint64_t* getNtvTraps(void);
+    const uint64_t* getVpcTraps(void);
     bool getStartMusic(void);
 
     bool getPageUpButton(void);
@@ -105,6 +108,9 @@ namespace Editor
     void addVpcBreakPoint(uint16_t address);
     void clearVpcBreakPoints(void);
 
+    void addGprintfTrap(uint16_t address);
+    void clearGprintfTraps(void);
+
     int getFileEntriesIndex(void);
     int getFileEntriesSize(void);
     FileType getFileEntryType(int index);
@@ -139,7 +145,7 @@ namespace Editor
 
     int getEmulatorScanCode(const std::string& keyWord);
 
-#ifndef STAND_ALONE
+#if !defined(STAND_ALONE)  &&  !defined(HEADLESS)
     SDL_Keymod getEmulatorKeyMod(const std::string& keyWord);
 #endif
 
@@ -150,11 +156,11 @@ namespace Editor
 
     void browseDirectory(void);
 
-#ifndef STAND_ALONE
+#if !defined(STAND_ALONE)  &&  !defined(HEADLESS)
     void handleGuiEvents(SDL_Event& event);
 #endif
 
-    bool handleDebugger(void);
+    bool handleDebugger(bool vpcTrap=false);
     void handleInput(void);
     void handleTerminalInput(void);
 
@@ -4,6 +4,10 @@
 #include <iostream>
 #include <algorithm>
 #include <atomic>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <chrono>
 
 #include "graphics.h"
 #include "memory.h"
@@ -15,6 +19,13 @@
 #include "inih/INIReader.h"
 #include "defaultKeys.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)  ||  defined(_M_X64)  ||  (defined(_M_IX86_FP)  &&  _M_IX86_FP >= 2)
+#define GRAPHICS_SSE2
+#include <emmintrin.h>
+#endif
+
 // Use this if you ever want to change the default font, but it better be 6x8 per char or otherwise you will be in a world of hurt
 //#define CREATE_FONT_HEADER
 #ifndef CREATE_FONT_HEADER
@@ -22,6 +33,12 @@
 #endif
 
 
+#define NUM_FRAMES       3
+#define FRAME_FRESH      0x80 // middle frame hasn't been presented yet
+#define FRAME_INDEX      0x03
+#define EVENT_QUEUE_SIZE 1024
+
+
 namespace Graphics
 {
     int _width, _height;
@@ -50,9 +67,87 @@ namespace Graphics
     uint32_t _colours[COLOUR_PALETTE];
     uint32_t _hlineTiming[GIGA_HEIGHT];
 
+    // Native resolution video, one texel per Gigatron pixel per VGA line, the renderer does the 3x horizontal scaling; only the lines
+    // whose OUT bytes changed since the last frame are converted and uploaded
+    uint8_t _videoLines[SCREEN_HEIGHT][GIGA_WIDTH];
+    uint32_t _videoPixels[SCREEN_HEIGHT][GIGA_WIDTH];
+    int _videoDirtyTop = 0, _videoDirtyBottom = SCREEN_HEIGHT - 1;
+
+    int _overlayDirtyTop = 0, _overlayDirtyBottom = SCREEN_HEIGHT - 1;
+    bool _pixelsScreen = false; // the whole screen comes from _pixels, (the debugger's RAM view, the terminal and the image editor)
+
     SDL_Window* _window = NULL;
     SDL_Renderer* _renderer = NULL;
     SDL_Texture* _screenTexture = NULL;
+    SDL_Texture* _videoTexture = NULL;
+    SDL_Texture* _overlayTexture = NULL;
+
+    // Completed frames go from the emulation thread to the main thread through a triple buffer, the emulation owns the back frame, the
+    // presenter owns the front frame and they swap with the middle one; each frame knows which rows it is behind the live buffers by,
+    // (stale), and which rows the presenter has to upload for it, (dirty)
+    struct Rows
+    {
+        int _top = SCREEN_HEIGHT, _bottom = -1;
+
+        void add(int top, int bottom) {_top = std::min(_top, top), _bottom = std::max(_bottom, bottom);}
+        void add(const Rows& rows) {add(rows._top, rows._bottom);}
+        void clear(void) {_top = SCREEN_HEIGHT, _bottom = -1;}
+        bool empty(void) const {return _top > _bottom;}
+    };
+    struct Frame
+    {
+        uint32_t _video[SCREEN_HEIGHT][GIGA_WIDTH];
+        uint32_t _pixels[SCREEN_WIDTH * SCREEN_HEIGHT];
+        Rows _staleVideo, _stalePixels;
+        Rows _dirtyVideo, _dirtyPixels;
+        bool _pixelsScreen = false;
+        uint8_t _helpAlpha = 0;
+    };
+    Frame _frames[NUM_FRAMES];
+    int _backFrame = 0, _frontFrame = 1;
+    std::atomic<int> _middleFrame(2);
+
+    // SDL events from the main thread to the emulation thread, each with the mouse and keyboard state as it was when it was polled, (SDL's
+    // state functions are only safe to call on the main thread); the emulation thread sees the state of the last event it took
+    struct Event
+    {
+        SDL_Event _event;
+        int _mouseX = 0, _mouseY = 0;
+        uint32_t _mouseButtons = 0;
+        bool _anyKeyPressed = false;
+    };
+    Event _events[EVENT_QUEUE_SIZE];
+    Event _polled;
+    std::atomic<uint32_t> _eventHead(0);
+    std::atomic<uint32_t> _eventTail(0);
+
+    // Clipboard writes from the emulation thread, set by the presenter
+    std::mutex _clipboardMutex;
+    std::string _clipboardText;
+    std::atomic<bool> _clipboardPending(false);
+
+    enum PresentState {Presenting=0, ShutdownRequested, ShutdownDone};
+    std::atomic<bool> _presenting(false);
+    std::atomic<int> _presentState(Presenting);
+    std::thread::id _presenterId;
+
+    // One bit per font pixel, one byte per glyph row, decoded once from the font surface
+    uint8_t _glyphs[FONT_GLYPHS][FONT_HEIGHT];
+
+    // Every text field drawn into the panel, keyed by position; a field is only redrawn when it's contents change or when something else
+    // has drawn over it since
+    struct TextField
+    {
+        int _x, _y, _w;
+        std::string _text;
+        uint32_t _fgColour, _bgColour;
+        bool _invert, _colourKey;
+        int _invertSize, _invertPos, _numChars;
+        bool _result;
+        bool _valid;
+    };
+    std::vector<TextField> _textFields;
+    std::map<uint32_t, int> _textFieldIndices;
     SDL_Texture* _helpTexture = NULL;
     SDL_Surface* _helpSurface = NULL;
     SDL_Surface* _fontSurface = NULL;
@@ -165,6 +260,38 @@ namespace Graphics
         outfile << "\n};" << std::endl;
     }
 
+    void createGlyphs(void)
+    {
+        uint32_t* fontPixels = (uint32_t*)_fontSurface->pixels;
+        for(int i=0; i<FONT_GLYPHS; i++)
+        {
+            int srcx = (i % CHARS_PER_ROW)*FONT_WIDTH, srcy = (i / CHARS_PER_ROW)*FONT_HEIGHT;
+            for(int k=0; k<FONT_HEIGHT; k++)
+            {
+                uint8_t bits = 0;
+                for(int j=0; j<FONT_WIDTH; j++)
+                {
+                    if(fontPixels[(srcx + j)  +  (srcy + k)*FONT_BMP_WIDTH] & 0x00FFFFFF) bits |= 1 << j;
+                }
+                _glyphs[i][k] = bits;
+            }
+        }
+    }
+
+    // Anything drawn into the screen's pixels marks the text fields it overlaps as stale and the overlay rows it covers as dirty
+    void invalidateText(int x, int y, int w, int h, int field=-1)
+    {
+        for(int i=0; i<int(_textFields.size()); i++)
+        {
+            TextField& textField = _textFields[i];
+            if(!textField._valid  ||  i == field) continue;
+            if(x < textField._x + textField._w  &&  textField._x < x + w  &&  y < textField._y + FONT_HEIGHT  &&  textField._y < y + h) textField._valid = false;
+        }
+
+        _overlayDirtyTop = std::min(_overlayDirtyTop, std::max(y, 0));
+        _overlayDirtyBottom = std::max(_overlayDirtyBottom, std::min(y + h - 1, SCREEN_HEIGHT - 1));
+    }
+
     void createHelpTexture(void)
     {
         bool useDefault = false;
@@ -261,6 +388,12 @@ namespace Graphics
             //fprintf(stderr, "%08X\n", _colours[i]); // use to create a Paint.Net palette
         }
 
+        // Matches the zeroed OUT bytes that the first frame is compared against
+        for(int y=0; y<SCREEN_HEIGHT; y++)
+        {
+            for(int x=0; x<GIGA_WIDTH; x++) _videoPixels[y][x] = _colours[0];
+        }
+
         // Safe resolution by default
         SDL_DisplayMode DM;
         SDL_GetCurrentDisplayMode(0, &DM);
@@ -396,9 +529,18 @@ namespace Graphics
             }
         }
 
+        // The renderer's vsync only paces frames if the driver honoured it and the display runs at the Gigatron's rate, otherwise
+        // Timing::synchronise() still has to
+        SDL_RendererInfo info;
+        bool presentVSync = SDL_GetRendererInfo(_renderer, &info) == 0  &&  (info.flags & SDL_RENDERER_PRESENTVSYNC);
+        Timing::setVSyncLock(_vSync  &&  presentVSync  &&  DM.refresh_rate >= VSYNC_RATE - 1  &&  DM.refresh_rate <= VSYNC_RATE + 1);
+        Timing::setHostRefresh(DM.refresh_rate);
+
         // Screen texture
         _screenTexture = SDL_CreateTexture(_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
-        if(_screenTexture == NULL)
+        _videoTexture = SDL_CreateTexture(_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, GIGA_WIDTH, SCREEN_HEIGHT);
+        _overlayTexture = SDL_CreateTexture(_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, OVERLAY_WIDTH, SCREEN_HEIGHT);
+        if(_screenTexture == NULL  ||  _videoTexture == NULL  ||  _overlayTexture == NULL)
         {
             Cpu::shutdown();
             fprintf(stderr, "Graphics::initialise() :  failed to create SDL texture.\n");
@@ -428,6 +570,7 @@ namespace Graphics
         _fontSurface = createSurface(FONT_BMP_WIDTH, FONT_BMP_HEIGHT);
         writeToSurface(_fontSurface, _emuFont96x48, FONT_BMP_WIDTH, FONT_BMP_HEIGHT);
 #endif
+        createGlyphs();
 
         // Help screen
         _helpSurface = createSurface(SCREEN_WIDTH, SCREEN_HEIGHT);
@@ -507,41 +650,110 @@ namespace Graphics
         if(debugging) return;
 
         uint32_t screen = (vgaX % (GIGA_WIDTH + 1))*3 + (pixelY % GIGA_HEIGHT)*4*SCREEN_WIDTH;
+        if(_pixels[screen] != colour) invalidateText(vgaX*3, pixelY*4, 3, 4);
         _pixels[screen + 0 + 0*SCREEN_WIDTH] = colour; _pixels[screen + 1 + 0*SCREEN_WIDTH] = colour; _pixels[screen + 2 + 0*SCREEN_WIDTH] = colour;
         _pixels[screen + 0 + 1*SCREEN_WIDTH] = colour; _pixels[screen + 1 + 1*SCREEN_WIDTH] = colour; _pixels[screen + 2 + 1*SCREEN_WIDTH] = colour;
         _pixels[screen + 0 + 2*SCREEN_WIDTH] = colour; _pixels[screen + 1 + 2*SCREEN_WIDTH] = colour; _pixels[screen + 2 + 2*SCREEN_WIDTH] = colour;
         _pixels[screen + 0 + 3*SCREEN_WIDTH] = 0x00;   _pixels[screen + 1 + 3*SCREEN_WIDTH] = 0x00;   _pixels[screen + 2 + 3*SCREEN_WIDTH] = 0x00;
     }
 
-    void refreshPixel(const Cpu::State& S, int vgaX, int vgaY)
+    // A whole scanline of OUT bytes at once, unchanged lines are skipped; SSE2 by default, (every x86-64 build), AVX2's gather when the
+    // build enables it
+    void refreshScanline(const uint8_t* line, int vgaY)
+    {
+        _pixelsScreen = false;
+
+        if(memcmp(_videoLines[vgaY], line, GIGA_WIDTH) == 0) return;
+        memcpy(_videoLines[vgaY], line, GIGA_WIDTH);
+
+        _videoDirtyTop = std::min(_videoDirtyTop, vgaY);
+        _videoDirtyBottom = std::max(_videoDirtyBottom, vgaY);
+
+        uint32_t* pixels = _videoPixels[vgaY];
+#if defined(__AVX2__)
+        const __m256i mask = _mm256_set1_epi32(COLOUR_PALETTE - 1);
+        for(int x=0; x<GIGA_WIDTH; x+=8)
+        {
+            __m256i index = _mm256_and_si256(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&line[x])), mask);
+            _mm256_storeu_si256((__m256i*)&pixels[x], _mm256_i32gather_epi32((const int*)_colours, index, 4));
+        }
+#elif defined(GRAPHICS_SSE2)
+        for(int x=0; x<GIGA_WIDTH; x+=4)
+        {
+            __m128i colours = _mm_setr_epi32(int(_colours[line[x + 0] & (COLOUR_PALETTE - 1)]), int(_colours[line[x + 1] & (COLOUR_PALETTE - 1)]),
+                                             int(_colours[line[x + 2] & (COLOUR_PALETTE - 1)]), int(_colours[line[x + 3] & (COLOUR_PALETTE - 1)]));
+            _mm_storeu_si128((__m128i*)&pixels[x], colours);
+        }
+#else
+        for(int x=0; x<GIGA_WIDTH; x++) pixels[x] = _colours[line[x] & (COLOUR_PALETTE - 1)];
+#endif
+    }
+
+    // Expands one row of indexed pixels 3x horizontally into the screen, SSE2 shuffles 4 pixels into 12 by default, AVX2 permutes 8 into 24
+    void expandRow(const uint8_t* line, uint32_t* pixels)
     {
-        uint32_t colour = _colours[S._OUT & (COLOUR_PALETTE - 1)];
-        uint32_t address = (vgaX % GIGA_WIDTH)*3 + (vgaY % SCREEN_HEIGHT)*SCREEN_WIDTH;
-        _pixels[address + 0] = colour;
-        _pixels[address + 1] = colour;
-        _pixels[address + 2] = colour;
+#if defined(__AVX2__)
+        const __m256i mask = _mm256_set1_epi32(COLOUR_PALETTE - 1);
+        const __m256i triple0 = _mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2);
+        const __m256i triple1 = _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5);
+        const __m256i triple2 = _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7);
+        for(int x=0; x<GIGA_WIDTH; x+=8)
+        {
+            __m256i index = _mm256_and_si256(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&line[x])), mask);
+            __m256i colours = _mm256_i32gather_epi32((const int*)_colours, index, 4);
+            _mm256_storeu_si256((__m256i*)&pixels[x*3 + 0],  _mm256_permutevar8x32_epi32(colours, triple0));
+            _mm256_storeu_si256((__m256i*)&pixels[x*3 + 8],  _mm256_permutevar8x32_epi32(colours, triple1));
+            _mm256_storeu_si256((__m256i*)&pixels[x*3 + 16], _mm256_permutevar8x32_epi32(colours, triple2));
+        }
+#elif defined(GRAPHICS_SSE2)
+        for(int x=0; x<GIGA_WIDTH; x+=4)
+        {
+            __m128i colours = _mm_setr_epi32(int(_colours[line[x + 0] & (COLOUR_PALETTE - 1)]), int(_colours[line[x + 1] & (COLOUR_PALETTE - 1)]),
+                                             int(_colours[line[x + 2] & (COLOUR_PALETTE - 1)]), int(_colours[line[x + 3] & (COLOUR_PALETTE - 1)]));
+            _mm_storeu_si128((__m128i*)&pixels[x*3 + 0], _mm_shuffle_epi32(colours, _MM_SHUFFLE(1, 0, 0, 0)));
+            _mm_storeu_si128((__m128i*)&pixels[x*3 + 4], _mm_shuffle_epi32(colours, _MM_SHUFFLE(2, 2, 1, 1)));
+            _mm_storeu_si128((__m128i*)&pixels[x*3 + 8], _mm_shuffle_epi32(colours, _MM_SHUFFLE(3, 3, 3, 2)));
+        }
+#else
+        for(int x=0; x<GIGA_WIDTH; x++)
+        {
+            uint32_t colour = _colours[line[x] & (COLOUR_PALETTE - 1)];
+            pixels[x*3 + 0] = colour; pixels[x*3 + 1] = colour; pixels[x*3 + 2] = colour;
+        }
+#endif
     }
 
+    // Rebuilds the whole screen from RAM through the video table, one vTable entry per row, each scanline wraps within it's page so it
+    // is fetched in at most two spans; the 4th line of each row is blank and the pixel after the row is the hline timing
     void refreshScreen(void)
     {
+        int sizeRAM;
+        const uint8_t* RAM = Cpu::getPtrToRAM(sizeRAM);
+
+        uint8_t line[GIGA_WIDTH];
         uint8_t offsetx = 0;
 
-        for (int y = 0; y<GIGA_HEIGHT; y++)
+        for(int y=0; y<GIGA_HEIGHT; y++)
         {
-            offsetx += Cpu::getRAM(uint16_t(GIGA_VTABLE + 1 + y * 2));
-
-            for (int x = 0; x <= GIGA_WIDTH; x++)
-            {
-                uint16_t address = (Cpu::getRAM(uint16_t(GIGA_VTABLE + y * 2)) << 8) + ((offsetx + x) & 0xFF);
-                uint32_t colour = (x < GIGA_WIDTH) ? _colours[Cpu::getRAM(address) & (COLOUR_PALETTE - 1)] : _hlineTiming[y];
-                uint32_t screen = (y * 4 % SCREEN_HEIGHT)*SCREEN_WIDTH + (x * 3 % SCREEN_WIDTH);
-
-                _pixels[screen + 0 + 0 * SCREEN_WIDTH] = colour; _pixels[screen + 1 + 0 * SCREEN_WIDTH] = colour; _pixels[screen + 2 + 0 * SCREEN_WIDTH] = colour;
-                _pixels[screen + 0 + 1 * SCREEN_WIDTH] = colour; _pixels[screen + 1 + 1 * SCREEN_WIDTH] = colour; _pixels[screen + 2 + 1 * SCREEN_WIDTH] = colour;
-                _pixels[screen + 0 + 2 * SCREEN_WIDTH] = colour; _pixels[screen + 1 + 2 * SCREEN_WIDTH] = colour; _pixels[screen + 2 + 2 * SCREEN_WIDTH] = colour;
-                _pixels[screen + 0 + 3 * SCREEN_WIDTH] = 0x00;   _pixels[screen + 1 + 3 * SCREEN_WIDTH] = 0x00;   _pixels[screen + 2 + 3 * SCREEN_WIDTH] = 0x00;
-            }
+            const uint8_t* vTable = &RAM[GIGA_VTABLE + y*2];
+            const uint8_t* page = &RAM[(vTable[0] <<8) & (sizeRAM - 1)];
+            offsetx += vTable[1];
+
+            int span = std::min(GIGA_WIDTH, 256 - offsetx);
+            memcpy(&line[0], &page[offsetx], span);
+            memcpy(&line[span], &page[0], GIGA_WIDTH - span);
+
+            uint32_t* pixels = &_pixels[y*4*SCREEN_WIDTH];
+            expandRow(line, pixels);
+            pixels[GIGA_WIDTH*3 + 0] = _hlineTiming[y]; pixels[GIGA_WIDTH*3 + 1] = _hlineTiming[y]; pixels[GIGA_WIDTH*3 + 2] = _hlineTiming[y];
+
+            const int rowSize = (GIGA_WIDTH + 1)*3*sizeof(uint32_t);
+            memcpy(pixels + 1*SCREEN_WIDTH, pixels, rowSize);
+            memcpy(pixels + 2*SCREEN_WIDTH, pixels, rowSize);
+            memset(pixels + 3*SCREEN_WIDTH, 0x00, rowSize);
         }
+
+        _pixelsScreen = true;
     }
 
     void clearScreen(uint32_t colour, uint32_t commandLineColour)
@@ -561,6 +773,10 @@ namespace Graphics
                 _pixels[y*SCREEN_WIDTH + x] = commandLineColour;
             }
         }
+
+        _textFields.clear();
+        _textFieldIndices.clear();
+        _pixelsScreen = true;
     }
 
     void pixelReticle(const Cpu::State& S, int vgaX, int vgaY)
@@ -585,6 +801,7 @@ namespace Graphics
                 uint32_t colour = state ? 0xFF00FF00 : 0xFF770000;
 
                 int address = int(float(SCREEN_WIDTH) * 0.866f) + i*NUM_LEDS + 3*SCREEN_WIDTH;
+                if(_pixels[address] != colour) invalidateText(address % SCREEN_WIDTH, 3, 3, 2);
                 _pixels[address + 0] = colour;
                 _pixels[address + 1] = colour;
                 _pixels[address + 2] = colour;
@@ -607,8 +824,37 @@ namespace Graphics
         }
         if(x<0 || x>=SCREEN_WIDTH || y<0 || y>=SCREEN_HEIGHT) return false;
 
-        uint32_t* fontPixels = (uint32_t*)_fontSurface->pixels;
         numChars = (numChars == -1) ? int(text.size()) : numChars;
+
+        // Panel fields that are unchanged and intact are skipped, (drawing stops at the end of the text whatever numChars is)
+        int field = -1;
+        if(pixels == _pixels  &&  !fullscreen  &&  !commentColour  &&  !sectionColour)
+        {
+            uint32_t key = (uint32_t(y) <<16) | uint32_t(x);
+            auto it = _textFieldIndices.find(key);
+            if(it == _textFieldIndices.end())
+            {
+                field = int(_textFields.size());
+                _textFieldIndices[key] = field;
+                _textFields.push_back(TextField());
+            }
+            else
+            {
+                field = it->second;
+            }
+
+            TextField& textField = _textFields[field];
+            if(textField._valid  &&  textField._text == text  &&  textField._fgColour == fgColour  &&  textField._bgColour == bgColour  &&  textField._invert == invert  &&
+               textField._colourKey == colourKey  &&  textField._invertSize == invertSize  &&  textField._invertPos == invertPos  &&  textField._numChars == numChars)
+            {
+                return textField._result;
+            }
+
+            textField = {x, y, std::min(numChars, int(text.size()))*FONT_WIDTH, text, fgColour, bgColour, invert, colourKey, invertSize, invertPos, numChars, false, false};
+        }
+        if(pixels == _pixels) invalidateText(x, y, std::min(numChars, int(text.size()))*FONT_WIDTH, FONT_HEIGHT, field);
+
+        bool result = true;
         for(int i=0; i<numChars; i++)
         {
             if(sectionColour)
@@ -628,35 +874,46 @@ namespace Graphics
             }
 
             uint8_t chr = text.c_str()[i] - 32;
-            uint8_t row = chr % CHARS_PER_ROW;
-            uint8_t col = chr / CHARS_PER_ROW;
-
-            int srcx = row*FONT_WIDTH, srcy = col*FONT_HEIGHT;
-            if(srcx+FONT_WIDTH-1>=FONT_BMP_WIDTH || srcy+FONT_HEIGHT-1>=FONT_BMP_HEIGHT) return false;
+            if(chr >= FONT_GLYPHS)
+            {
+                result = false;
+                break;
+            }
 
             int dstx = x + i*FONT_WIDTH, dsty = y;
-            if(dstx+FONT_WIDTH-1>=SCREEN_WIDTH-FONT_WIDTH || dsty+FONT_HEIGHT-1>=SCREEN_HEIGHT) return false;
+            if(dstx+FONT_WIDTH-1>=SCREEN_WIDTH-FONT_WIDTH || dsty+FONT_HEIGHT-1>=SCREEN_HEIGHT)
+            {
+                result = false;
+                break;
+            }
 
-            for(int j=0; j<FONT_WIDTH; j++)
+            uint8_t mask = (invert  &&  i>=invertPos  &&  i<invertPos+invertSize) ? (1 << FONT_WIDTH) - 1 : 0;
+            uint32_t fg = 0xFF000000 | fgColour, bg = 0xFF000000 | bgColour;
+            for(int k=0; k<FONT_HEIGHT; k++)
             {
-                for(int k=0; k<FONT_HEIGHT; k++)
+                uint8_t bits = _glyphs[chr][k] ^ mask;
+                uint32_t* row = &pixels[dstx + (dsty + k)*SCREEN_WIDTH];
+                for(int j=0; j<FONT_WIDTH; j++)
                 {
-                    int fontAddress = (srcx + j)  +  (srcy + k)*FONT_BMP_WIDTH;
-                    int pixelAddress = (dstx + j)  +  (dsty + k)*SCREEN_WIDTH;
-                    uint32_t fontPixel = fontPixels[fontAddress] & 0x00FFFFFF;
-                    if((invert  &&  i>=invertPos  &&  i<invertPos+invertSize) ? !fontPixel : fontPixel)
+                    if((bits >> j) & 1)
                     {
-                        pixels[pixelAddress] = 0xFF000000 | fgColour;
+                        row[j] = fg;
                     }
                     else
                     {
-                        if(!colourKey) pixels[pixelAddress] = 0xFF000000 | bgColour;
+                        if(!colourKey) row[j] = bg;
                     }
                 }
             }
         }
 
-        return true;
+        if(field >= 0)
+        {
+            _textFields[field]._result = result;
+            _textFields[field]._valid = true;
+        }
+
+        return result;
     }
 
     bool drawText(const std::string& text, int x, int y, uint32_t fgColour, bool invert, int invertSize, int invertPos)
@@ -676,6 +933,7 @@ namespace Graphics
         if(x<0 || x>=SCREEN_WIDTH || y<0 || y>=SCREEN_HEIGHT) return;
 
         uint32_t pixelAddress = x + digit*FONT_WIDTH + y*SCREEN_WIDTH;
+        invalidateText(x + digit*FONT_WIDTH, y + FONT_HEIGHT-1, FONT_WIDTH, 1);
 
         pixelAddress += (FONT_HEIGHT-1)*SCREEN_WIDTH;
         for(int i=0; i<FONT_WIDTH; i++) _pixels[pixelAddress+i] = colour;
@@ -699,6 +957,7 @@ namespace Graphics
 
         x += MENU_START_X;
         y += MENU_START_Y;
+        invalidateText(x, y, w, h);
 
         for(int j=y; j<(y + h); j++)
         {
@@ -748,7 +1007,14 @@ namespace Graphics
             drawText(std::string(str), _pixels, FONT_WIDTH*4, FONT_CELL_Y*2, 0x80808080, false, 0, 0, 0x00000000, true);
 
             //drawText(std::string("LEDS:"), _pixels, 0, 0, 0xFFFFFFFF, false, 0);
-            sprintf(str, "FPS %5.1f  XOUT:%02X IN:%02X", 1.0f / Timing::getFrameTime(), Cpu::getXOUT(), Cpu::getIN());
+            if(Timing::getTurbo())
+            {
+                sprintf(str, "SPD %5.1fx XOUT:%02X IN:%02X", Timing::getEmulationSpeed(), Cpu::getXOUT(), Cpu::getIN());
+            }
+            else
+            {
+                sprintf(str, "FPS %5.1f  XOUT:%02X IN:%02X", 1.0f / Timing::getFrameTime(), Cpu::getXOUT(), Cpu::getIN());
+            }
             drawText(std::string(str), _pixels, 0, FONT_CELL_Y, 0xFFFFFFFF, false, 0);
             drawText("M:              R:", _pixels, 0, 472 - FONT_CELL_Y, 0xFFFFFFFF, false, 0);
 
@@ -820,7 +1086,7 @@ namespace Graphics
                 uint32_t colour = (Editor::getHexEdit() && Editor::getMemoryMode() == Editor::RAM && onCursor) ? 0xFF00FF00 : 0xFFB0B0B0;
                 drawText(std::string(str), _pixels, HEX_START_X + i*HEX_CHAR_WIDE, FONT_CELL_Y*4 + j*(FONT_HEIGHT+FONT_GAP_Y), colour, onCursor, 2);
                 if(onCursor) cursorAddress = hexAddress;
-                hexAddress = (hexAddress + 1) & (Memory::getSizeRAM() - 1);
+                hexAddress = (hexAddress + 1) & (Cpu::getSizeRAM() - 1);
             }
         }
 
@@ -841,22 +1107,34 @@ namespace Graphics
         return hexDigitIndex;
     }
 
+    // A row of the text window padded with spaces to the window's width, so that the window never has to be cleared before it's redrawn
+    void drawWindowRow(const std::string& text, int x, int y, uint32_t colour, bool invert)
+    {
+        drawText(text, _pixels, x, y, colour, invert, MENU_TEXT_SIZE, 0, 0x00000000, false, MENU_TEXT_SIZE);
+
+        int padX = x + int(text.size())*FONT_WIDTH;
+        int endX = HEX_START_X + MENU_TEXT_SIZE*FONT_WIDTH;
+        if(padX < endX) drawText(std::string((endX - padX) / FONT_WIDTH, ' '), _pixels, padX, y, 0xFFFFFFFF, false, 0);
+    }
+
     void renderRomBrowser(void)
     {
         drawText("ROM:       Vars:", _pixels, 0, FONT_CELL_Y*3, 0xFFFFFFFF, false, 0);
 
-        // Clear window
-        for(int i=0; i<HEX_CHARS_Y; i++) drawText("                       ", _pixels, HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y, 0xFFFFFFFF, false, 0);
-
         // ROM list
         for(int i=0; i<HEX_CHARS_Y; i++)
         {
             bool onCursor = (i == Editor::getCursorY());
             int index = Editor::getRomEntriesIndex() + i;
-            if(index >= int(Editor::getRomEntriesSize())) break;
+            if(index >= int(Editor::getRomEntriesSize()))
+            {
+                drawWindowRow("", HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y, 0xFFFFFFFF, false);
+                continue;
+            }
             uint32_t colour = (i < NUM_INT_ROMS) ? 0xFFB0B0B0 : 0xFFFFFFFF;
-            if(i == Cpu::getRomIndex()) drawText("*", _pixels, HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y,  0xFFD0D000, onCursor, MENU_TEXT_SIZE, 0, 0x00000000, false, MENU_TEXT_SIZE);
-            drawText(*Editor::getRomEntryName(index), _pixels, HEX_START_X + 6, FONT_CELL_Y*4 + i*FONT_CELL_Y, colour, onCursor, MENU_TEXT_SIZE, 0, 0x00000000, false, MENU_TEXT_SIZE);
+            (i == Cpu::getRomIndex()) ? drawText("*", _pixels, HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y,  0xFFD0D000, onCursor, MENU_TEXT_SIZE, 0, 0x00000000, false, MENU_TEXT_SIZE) :
+                                        drawText(" ", _pixels, HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y,  0xFFFFFFFF, false, 0);
+            drawWindowRow(*Editor::getRomEntryName(index), HEX_START_X + 6, FONT_CELL_Y*4 + i*FONT_CELL_Y, colour, onCursor);
         }
 
         // ROM type
@@ -871,17 +1149,18 @@ namespace Graphics
 
         drawText("Load:      Vars:", _pixels, 0, FONT_CELL_Y*3, 0xFFFFFFFF, false, 0);
 
-        // Clear window
-        for(int i=0; i<HEX_CHARS_Y; i++) drawText("                       ", _pixels, HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y, 0xFFFFFFFF, false, 0);
-
         // File list
         for(int i=0; i<HEX_CHARS_Y; i++)
         {
             bool onCursor = (i == Editor::getCursorY());
             int index = Editor::getFileEntriesIndex() + i;
-            if(index >= int(Editor::getFileEntriesSize())) break;
+            if(index >= int(Editor::getFileEntriesSize()))
+            {
+                drawWindowRow("", HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y, 0xFFFFFFFF, false);
+                continue;
+            }
             uint32_t colour = (Editor::getFileEntryType(index) == Editor::Dir) ? 0xFFB0B0B0 : 0xFFFFFFFF;
-            drawText(*Editor::getFileEntryName(index), _pixels, HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y, colour, onCursor, MENU_TEXT_SIZE, 0, 0x00000000, false, MENU_TEXT_SIZE);
+            drawWindowRow(*Editor::getFileEntryName(index), HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y, colour, onCursor);
         }
 
         // Load address
@@ -901,8 +1180,7 @@ namespace Graphics
         //sprintf(str, "%d\n", Editor::getNtvBreakpointsSize());
         //fprintf(stderr, str);
 
-        // Clear window
-        for(int i=0; i<HEX_CHARS_Y; i++) drawText("                       ", _pixels, HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y, 0xFFFFFFFF, false, 0);
+        for(int i=Assembler::getDisassembledCodeSize(); i<HEX_CHARS_Y; i++) drawWindowRow("", HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y, 0xFFFFFFFF, false);
 
         for(int i=0; i<Assembler::getDisassembledCodeSize(); i++)
         {
@@ -921,6 +1199,7 @@ namespace Graphics
 
             // Program counter icon in debug mode
             bool onCursor = (i == Editor::getCursorY());
+            bool onBrkPoint = false;
             if(onPC) drawText(">", _pixels, HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y,  0xFF00FF00, onCursor, MENU_TEXT_SIZE, 0, 0x00000000, false, MENU_TEXT_SIZE);
 
             // Breakpoint icons
@@ -931,6 +1210,7 @@ namespace Graphics
                     if(Assembler::getDisassembledCode(i)->_address == Editor::getVpcBreakPointAddress(j)  &&  Editor::getSingleStepEnabled())
                     {
                         drawText("*", _pixels, HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y,  0xFFC000C0, onCursor, MENU_TEXT_SIZE, 0, 0x00000000, false, MENU_TEXT_SIZE);
+                        onBrkPoint = true;
                         break;
                     }
                 }
@@ -942,15 +1222,18 @@ namespace Graphics
                     if(Assembler::getDisassembledCode(i)->_address == Editor::getNtvBreakPointAddress(j)  &&  Editor::getSingleStepEnabled())
                     {
                         drawText("*", _pixels, HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y,  0xFFC0C000, onCursor, MENU_TEXT_SIZE, 0, 0x00000000, false, MENU_TEXT_SIZE);
+                        onBrkPoint = true;
                         break;
                     }
                 }
             }
 
+            if(!onPC  &&  !onBrkPoint) drawText(" ", _pixels, HEX_START_X, FONT_CELL_Y*4 + i*FONT_CELL_Y, 0xFFFFFFFF, false, 0);
+
             // Mnemonic, highlight if on vPC and show cursor in debug mode
             uint32_t colour = (onPC) ? 0xFFFFFFFF : 0xFFB0B0B0;
             bool highlight = (onCursor || onPC)  &&  (Editor::getSingleStepEnabled());
-            drawText(Assembler::getDisassembledCode(i)->_text, _pixels, HEX_START_X+6, FONT_CELL_Y*4 + i*FONT_CELL_Y, colour, highlight, MENU_TEXT_SIZE, 0, 0x00000000, false, MENU_TEXT_SIZE);
+            drawWindowRow(Assembler::getDisassembledCode(i)->_text, HEX_START_X+6, FONT_CELL_Y*4 + i*FONT_CELL_Y, colour, highlight);
         }
 
         switch(Editor::getMemoryMode())
@@ -1095,30 +1378,224 @@ namespace Graphics
         }
     }
 
-    void renderHelpScreen(void)
+    void fadeHelpScreen(void)
+    {
+        // Fade help screen in
+        if(_displayHelpScreen  &&  _displayHelpScreenAlpha < 220)
+        {
+            _displayHelpScreenAlpha += 10;
+            if(_displayHelpScreenAlpha > 220) _displayHelpScreenAlpha = 220;
+        }
+        // Fade help screen out
+        if(!_displayHelpScreen  &&  _displayHelpScreenAlpha > 0)
+        {
+            _displayHelpScreenAlpha -= 10;
+            if(_displayHelpScreenAlpha > 240) _displayHelpScreenAlpha = 0;
+        }
+    }
+
+    // Brings the back frame up to date with the live buffers, (only the rows it is behind by), and swaps it into the middle
+    void publishFrame(void)
+    {
+        bool pixelsScreen = _pixelsScreen  ||  Editor::getEditorMode() == Editor::Term  ||  Editor::getEditorMode() == Editor::Image;
+        if(pixelsScreen) _overlayDirtyTop = 0, _overlayDirtyBottom = SCREEN_HEIGHT - 1;
+
+        Rows video, pixels;
+        video.add(_videoDirtyTop, _videoDirtyBottom);
+        pixels.add(_overlayDirtyTop, _overlayDirtyBottom);
+        _videoDirtyTop = SCREEN_HEIGHT, _videoDirtyBottom = -1;
+
+        // Back from the full screen, the overlay texture is out of date
+        if(pixelsScreen) _overlayDirtyTop = 0, _overlayDirtyBottom = SCREEN_HEIGHT - 1;
+        else _overlayDirtyTop = SCREEN_HEIGHT, _overlayDirtyBottom = -1;
+
+        for(int i=0; i<NUM_FRAMES; i++)
+        {
+            _frames[i]._staleVideo.add(video);
+            _frames[i]._stalePixels.add(pixels);
+        }
+
+        Frame& frame = _frames[_backFrame];
+        if(!frame._staleVideo.empty())
+        {
+            int top = frame._staleVideo._top, rows = frame._staleVideo._bottom - top + 1;
+            memcpy(frame._video[top], _videoPixels[top], rows * GIGA_WIDTH * sizeof(uint32_t));
+        }
+        if(!frame._stalePixels.empty())
+        {
+            int top = frame._stalePixels._top, rows = frame._stalePixels._bottom - top + 1;
+            memcpy(&frame._pixels[top*SCREEN_WIDTH], &_pixels[top*SCREEN_WIDTH], rows * SCREEN_WIDTH * sizeof(uint32_t));
+        }
+        frame._staleVideo.clear();
+        frame._stalePixels.clear();
+
+        fadeHelpScreen();
+        frame._pixelsScreen = pixelsScreen;
+        frame._helpAlpha = _displayHelpScreenAlpha;
+
+        // A middle frame that is replaced before it was presented hands it's uploads on, if the presenter takes it in the meantime the
+        // swap fails and is retried without them
+        int middle = _middleFrame.load(std::memory_order_acquire);
+        do
+        {
+            frame._dirtyVideo = video;
+            frame._dirtyPixels = pixels;
+            if(middle & FRAME_FRESH)
+            {
+                frame._dirtyVideo.add(_frames[middle & FRAME_INDEX]._dirtyVideo);
+                frame._dirtyPixels.add(_frames[middle & FRAME_INDEX]._dirtyPixels);
+            }
+        }
+        while(!_middleFrame.compare_exchange_weak(middle, _backFrame | FRAME_FRESH, std::memory_order_acq_rel, std::memory_order_acquire));
+
+        _backFrame = middle & FRAME_INDEX;
+    }
+
+    void presentFrame(const Frame& frame)
     {
-        // Only display help screen if it is enabled or has alpha > 0
-        if(_displayHelpScreen  ||  _displayHelpScreenAlpha)
+        if(!frame._dirtyVideo.empty())
+        {
+            SDL_Rect rect = {0, frame._dirtyVideo._top, GIGA_WIDTH, frame._dirtyVideo._bottom - frame._dirtyVideo._top + 1};
+            SDL_UpdateTexture(_videoTexture, &rect, frame._video[rect.y], GIGA_WIDTH * sizeof(uint32_t));
+        }
+
+        if(frame._pixelsScreen)
+        {
+            SDL_UpdateTexture(_screenTexture, NULL, frame._pixels, SCREEN_WIDTH * sizeof(uint32_t));
+            SDL_RenderCopy(_renderer, _screenTexture, NULL, NULL);
+        }
+        else
+        {
+            if(!frame._dirtyPixels.empty())
+            {
+                SDL_Rect rect = {0, frame._dirtyPixels._top, OVERLAY_WIDTH, frame._dirtyPixels._bottom - frame._dirtyPixels._top + 1};
+                SDL_UpdateTexture(_overlayTexture, &rect, &frame._pixels[rect.y*SCREEN_WIDTH + OVERLAY_X], SCREEN_WIDTH * sizeof(uint32_t));
+            }
+
+            int width, height;
+            SDL_GetRendererOutputSize(_renderer, &width, &height);
+            int split = width * OVERLAY_X / SCREEN_WIDTH;
+            SDL_Rect video = {0, 0, split, height};
+            SDL_Rect overlay = {split, 0, width - split, height};
+            SDL_RenderCopy(_renderer, _videoTexture, NULL, &video);
+            SDL_RenderCopy(_renderer, _overlayTexture, NULL, &overlay);
+        }
+
+        if(frame._helpAlpha)
         {
-            SDL_SetTextureAlphaMod(_helpTexture, _displayHelpScreenAlpha);
+            SDL_SetTextureAlphaMod(_helpTexture, frame._helpAlpha);
             SDL_RenderCopy(_renderer, _helpTexture, NULL, NULL);
-            // Fade help screen in
-            if(_displayHelpScreen  &&  _displayHelpScreenAlpha < 220)
+        }
+
+        SDL_RenderPresent(_renderer);
+        Timing::vSyncPresented();
+    }
+
+    void present(void)
+    {
+        _presenterId = std::this_thread::get_id();
+        _presenting = true;
+
+        for(;;)
+        {
+            // Shut down on behalf of the emulation thread, which exits the process once it's been told it is done
+            if(_presentState == ShutdownRequested)
+            {
+                _presenting = false;
+                Cpu::shutdown();
+                _presentState = ShutdownDone;
+                for(;;) std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+
+            // Events that don't fit are dropped, the emulation thread drains the queue at least once a frame
+            SDL_Event event;
+            while(SDL_PollEvent(&event))
+            {
+                uint32_t head = _eventHead.load(std::memory_order_relaxed);
+                if(head - _eventTail.load(std::memory_order_acquire) >= EVENT_QUEUE_SIZE) continue;
+
+                Event& queued = _events[head % EVENT_QUEUE_SIZE];
+                queued._event = event;
+                queued._mouseButtons = SDL_GetMouseState(&queued._mouseX, &queued._mouseY);
+
+                int numKeys;
+                const Uint8* keyboardState = SDL_GetKeyboardState(&numKeys);
+                queued._anyKeyPressed = std::any_of(keyboardState, keyboardState + numKeys, [](Uint8 key) {return key != 0;});
+
+                _eventHead.store(head + 1, std::memory_order_release);
+            }
+
+            if(_clipboardPending.exchange(false))
             {
-                _displayHelpScreenAlpha += 10;
-                if(_displayHelpScreenAlpha > 220) _displayHelpScreenAlpha = 220;
+                std::lock_guard<std::mutex> lock(_clipboardMutex);
+                SDL_SetClipboardText(_clipboardText.c_str());
             }
-            // Fade help screen out
-            if(!_displayHelpScreen  &&  _displayHelpScreenAlpha > 0)
+
+            // Nothing new to present, wait for events instead
+            if(!(_middleFrame.load(std::memory_order_acquire) & FRAME_FRESH))
             {
-                _displayHelpScreenAlpha -= 10;
-                if(_displayHelpScreenAlpha > 240) _displayHelpScreenAlpha = 0;
+                SDL_WaitEventTimeout(NULL, 1);
+                continue;
             }
+
+            _frontFrame = _middleFrame.exchange(_frontFrame, std::memory_order_acq_rel) & FRAME_INDEX;
+            presentFrame(_frames[_frontFrame]);
+        }
+    }
+
+    bool pollEvent(SDL_Event& event)
+    {
+        uint32_t tail = _eventTail.load(std::memory_order_relaxed);
+        if(tail == _eventHead.load(std::memory_order_acquire)) return false;
+
+        _polled = _events[tail % EVENT_QUEUE_SIZE];
+        _eventTail.store(tail + 1, std::memory_order_release);
+        event = _polled._event;
+        return true;
+    }
+
+    uint32_t getMouseState(int* x, int* y)
+    {
+        if(x) *x = _polled._mouseX;
+        if(y) *y = _polled._mouseY;
+        return _polled._mouseButtons;
+    }
+
+    bool getAnyKeyPressed(void) {return _polled._anyKeyPressed;}
+
+    void setClipboardText(const std::string& text)
+    {
+        if(!_presenting  ||  std::this_thread::get_id() == _presenterId)
+        {
+            SDL_SetClipboardText(text.c_str());
+            return;
         }
+
+        std::lock_guard<std::mutex> lock(_clipboardMutex);
+        _clipboardText = text;
+        _clipboardPending = true;
+    }
+
+    bool stopPresenting(void)
+    {
+        if(!_presenting  ||  std::this_thread::get_id() == _presenterId) return (_presentState == ShutdownDone);
+
+        int state = Presenting;
+        _presentState.compare_exchange_strong(state, ShutdownRequested);
+        while(_presentState != ShutdownDone) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        return true;
     }
 
     void render(bool synchronise)
     {
+        // Turbo, emulated frames in between host display refreshes are counted but never drawn
+        if(synchronise  &&  Timing::skipFrame())
+        {
+            Timing::synchronise();
+            return;
+        }
+
         drawLeds();
         renderText();
         renderTextWindow();
@@ -1138,10 +1615,7 @@ namespace Graphics
 #endif
 #endif
 
-        SDL_UpdateTexture(_screenTexture, NULL, _pixels, SCREEN_WIDTH * sizeof(uint32_t));
-        SDL_RenderCopy(_renderer, _screenTexture, NULL, NULL);
-        renderHelpScreen();
-        SDL_RenderPresent(_renderer);
+        publishFrame();
         if(synchronise) Timing::synchronise();
     }
 
@@ -1698,7 +2172,7 @@ namespace Graphics
         saveTetrominoState();
 
         SDL_Event event;
-        SDL_PollEvent(&event);
+        pollEvent(event);
 
         switch(event.type)
         {
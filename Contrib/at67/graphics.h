@@ -4,7 +4,9 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
+#ifndef HEADLESS
 #include <SDL.h>
+#endif
 
 #include "cpu.h"
 
@@ -14,6 +16,8 @@
 #define GIGA_WIDTH       160
 #define GIGA_HEIGHT      120
 #define GIGA_VRAM        0x0800
+#define OVERLAY_X        (GIGA_WIDTH*3)
+#define OVERLAY_WIDTH    (SCREEN_WIDTH - OVERLAY_X)
 #define GIGA_VTABLE      0x0100
 #define FONT_BMP_WIDTH   96
 #define FONT_BMP_HEIGHT  48
@@ -21,6 +25,7 @@
 #define FONT_HEIGHT      8
 #define FONT_GAP_Y       4
 #define FONT_CELL_Y      (FONT_HEIGHT+FONT_GAP_Y)
+#define FONT_GLYPHS      ((FONT_BMP_WIDTH/FONT_WIDTH) * (FONT_BMP_HEIGHT/FONT_HEIGHT))
 #define MAX_CHARS_SCREEN (SCREEN_WIDTH/FONT_WIDTH)
 #define MAX_CHARS_HELP   80
 #define CHARS_PER_ROW    16
@@ -59,12 +64,14 @@ namespace Graphics
     uint32_t* getPixels(void);
     uint32_t* getColours(void);
 
+#ifndef HEADLESS
     SDL_Window* getWindow(void);
     SDL_Renderer* getRenderer(void);
     SDL_Texture* getScreenTexture(void);
     SDL_Texture* getHelpTexture(void);
     SDL_Surface* getHelpSurface(void);
     SDL_Surface* getFontSurface(void);
+#endif
 
     void setDisplayHelpScreen(bool display);
     void setWidthHeight(int width, int height);
@@ -79,7 +86,7 @@ namespace Graphics
     void resetVTable(void);
 
     void refreshTimingPixel(const Cpu::State& S, int vgaX, int pixelY, uint32_t colour, bool debugging);
-    void refreshPixel(const Cpu::State& S, int vgaX, int vgaY);
+    void refreshScanline(const uint8_t* line, int vgaY);
     void refreshScreen(void);
 
     void clearScreen(uint32_t colour, uint32_t commandLineColour=0x22222222);
@@ -97,6 +104,20 @@ namespace Graphics
     void renderTextWindow(void);
     void render(bool synchronise=true);
 
+#ifndef HEADLESS
+    // The emulation runs on it's own thread and render() only publishes it's frames, the main thread presents them and forwards the SDL
+    // events back; stopPresenting() hands Cpu::shutdown() over to the main thread, (which owns SDL), and returns once it is done
+    void present(void);
+    bool pollEvent(SDL_Event& event);
+    bool stopPresenting(void);
+
+    // Stand ins for SDL's mouse, keyboard and clipboard functions on the emulation thread, the mouse and keyboard are as of the last event
+    // taken by pollEvent() and the clipboard is set by the main thread
+    uint32_t getMouseState(int* x, int* y);
+    bool getAnyKeyPressed(void);
+    void setClipboardText(const std::string& text);
+#endif
+
     void drawLineGiga(int x0, int y0, int x1, int y1);
     void drawLineGiga(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t colour);
     void mandelbrot(void);
@@ -0,0 +1,311 @@
+#include <stdint.h>
+
+#include "memory.h"
+#include "loader.h"
+#include "hle.h"
+
+
+#define HLE_VTMP 0x001D
+
+
+namespace Hle
+{
+    enum Opcode
+    {
+        LDWI=0x11, LD=0x1A, CMPHS=0x1F, LDW=0x21, STW=0x2B, BCC=0x35, LDI=0x59, ST=0x5E, POP=0x63, PUSH=0x75, ANDI=0x82, CALLI=0x85, ORI=0x88,
+        XORI=0x8C, BRA=0x90, INC=0x93, CMPHU=0x97, ADDW=0x99, PEEK=0xAD, SUBW=0xB8, DEF=0xCD, CALL=0xCF, ALLOC=0xDF, ADDI=0xE3, SUBI=0xE6,
+        LSLW=0xE9, STLW=0xEC, LDLW=0xEE, POKE=0xF0, DOKE=0xF3, DEEK=0xF6, ANDW=0xF8, ORW=0xFA, XORW=0xFC, RET=0xFF
+    };
+
+    enum Condition {CondEQ=0x3F, CondGT=0x4D, CondLT=0x50, CondGE=0x53, CondLE=0x56, CondNE=0x72};
+
+    // Native cycles from NEXT to NEXT, zero for anything left to the ROM's interpreter
+    int _costs[NumInstructionSets][256];
+
+
+    void initialiseCosts(void)
+    {
+        static bool initialised = false;
+        if(initialised) return;
+        initialised = true;
+
+        const struct {uint8_t _opcode; int _v1, _v5a;} costs[] =
+        {
+            {LDWI, 20, 20}, {LD,   18, 22}, {LDW,  20, 20}, {STW,  20, 20}, {BCC,  28, 28}, {LDI,  16, 16}, {ST,   16, 16}, {POP,  26, 26},
+            {PUSH, 26, 26}, {ANDI, 16, 22}, {ORI,  14, 14}, {XORI, 14, 14}, {BRA,  14, 14}, {INC,  16, 20}, {ADDW, 28, 28}, {PEEK, 26, 26},
+            {SUBW, 28, 28}, {DEF,  26, 24}, {CALL, 26, 26}, {ALLOC,14, 14}, {ADDI, 28, 28}, {SUBI, 28, 28}, {LSLW, 28, 28}, {STLW, 26, 26},
+            {LDLW, 26, 26}, {POKE, 26, 26}, {DOKE, 28, 28}, {DEEK, 28, 28}, {ANDW, 28, 28}, {ORW,  28, 28}, {XORW, 26, 26}, {RET,  20, 20},
+            {CALLI, 0, 28}, {CMPHS, 0, 28}, {CMPHU, 0, 28}
+        };
+
+        for(int i=0; i<int(sizeof(costs)/sizeof(costs[0])); i++)
+        {
+            _costs[vCpuV1][costs[i]._opcode] = costs[i]._v1;
+            _costs[vCpuV5a][costs[i]._opcode] = costs[i]._v5a;
+        }
+    }
+
+    int execute(uint8_t* RAM, uint16_t maskRAM, uint16_t vPC, InstructionSet instructionSet)
+    {
+        initialiseCosts();
+
+        uint8_t opcode = RAM[vPC & maskRAM];
+        int cost = _costs[instructionSet][opcode];
+        if(cost == 0) return 0;
+
+        // Operands are fetched with X++, so they wrap within vPC's page; carries come from the zero page constants, ([X] with X = carry<<7)
+        uint8_t pcL = uint8_t(vPC), pcH = uint8_t(vPC >>8);
+        uint8_t D = RAM[MAKE_ADDR(pcH, pcL + 1) & maskRAM];
+        uint8_t* vAC = &RAM[HLE_VAC];
+        uint16_t AC = vAC[0] | (vAC[1] <<8);
+        uint8_t nextL = pcL; // vPC's low byte at the end of the instruction, NEXT adds 2 before the next one
+
+        // A BCC with anything other than the six conditions is a computed jump into the ROM's BCC page
+        if(opcode == BCC  &&  D != CondEQ  &&  D != CondNE  &&  D != CondGT  &&  D != CondLT  &&  D != CondGE  &&  D != CondLE) return 0;
+
+        // NEXT's vPC update comes first, a POKE or DOKE into vPC then sticks just as it does natively
+        RAM[HLE_VPC] = pcL;
+
+        switch(opcode)
+        {
+            case LDWI:
+            {
+                vAC[0] = D;
+                vAC[1] = RAM[MAKE_ADDR(pcH, pcL + 2) & maskRAM];
+                nextL = uint8_t(pcL + 3 - 2);
+            }
+            break;
+
+            case LD:  vAC[0] = RAM[D], vAC[1] = 0; break;
+            case LDI: vAC[0] = D, vAC[1] = 0;      break;
+            case ST:  RAM[D] = vAC[0];             break;
+
+            case LDW:
+            {
+                RAM[HLE_VTMP] = uint8_t(D + 1);
+                vAC[0] = RAM[D];
+                vAC[1] = RAM[uint8_t(D + 1)];
+            }
+            break;
+
+            case STW:
+            {
+                RAM[HLE_VTMP] = uint8_t(D + 1);
+                RAM[D] = vAC[0];
+                RAM[uint8_t(D + 1)] = vAC[1];
+            }
+            break;
+
+            case LDLW:
+            case STLW:
+            {
+                uint8_t addr = uint8_t(D + RAM[HLE_VSP]);
+                RAM[HLE_VTMP] = addr;
+                if(opcode == LDLW)
+                {
+                    vAC[1] = RAM[uint8_t(addr + 1)];
+                    vAC[0] = RAM[addr];
+                }
+                else
+                {
+                    RAM[uint8_t(addr + 1)] = vAC[1];
+                    RAM[addr] = vAC[0];
+                }
+            }
+            break;
+
+            case ADDW:
+            case SUBW:
+            case ANDW:
+            case ORW:
+            case XORW:
+            {
+                RAM[HLE_VTMP] = (opcode == ADDW  ||  opcode == SUBW) ? uint8_t(D + 1) : D;
+                uint16_t W = RAM[D] | (RAM[uint8_t(D + 1)] <<8);
+                switch(opcode)
+                {
+                    case ADDW:
+                    {
+                        uint8_t carry = RAM[(vAC[0] + RAM[D] > 0xFF) ? ONE_CONST_ADDRESS : ZERO_CONST_ADDRESS];
+                        vAC[0] = uint8_t(vAC[0] + RAM[D]);
+                        vAC[1] = uint8_t(vAC[1] + carry + HI_BYTE(W));
+                    }
+                    break;
+
+                    case SUBW:
+                    {
+                        uint8_t borrow = RAM[(vAC[0] < RAM[D]) ? ONE_CONST_ADDRESS : ZERO_CONST_ADDRESS];
+                        vAC[0] = uint8_t(vAC[0] - RAM[D]);
+                        vAC[1] = uint8_t(vAC[1] - borrow - HI_BYTE(W));
+                    }
+                    break;
+
+                    // The delay slot of ANDW's return is ORW's 'st [vTmp]', with -28/2 or the result's low byte in AC
+                    case ANDW:
+                    {
+                        AC &= W; vAC[0] = LO_BYTE(AC), vAC[1] = HI_BYTE(AC);
+                        RAM[HLE_VTMP] = (instructionSet == vCpuV1) ? uint8_t(-28/2) : vAC[0];
+                    }
+                    break;
+
+                    case ORW:  AC |= W; vAC[0] = LO_BYTE(AC), vAC[1] = HI_BYTE(AC); break;
+                    case XORW: AC ^= W; vAC[0] = LO_BYTE(AC), vAC[1] = HI_BYTE(AC); break;
+
+                    default: break;
+                }
+            }
+            break;
+
+            case ADDI:
+            {
+                RAM[HLE_VTMP] = D;
+                uint8_t carry = RAM[(vAC[0] + D > 0xFF) ? ONE_CONST_ADDRESS : ZERO_CONST_ADDRESS];
+                vAC[0] = uint8_t(vAC[0] + D);
+                vAC[1] = uint8_t(vAC[1] + carry);
+            }
+            break;
+
+            case SUBI:
+            {
+                RAM[HLE_VTMP] = D;
+                uint8_t borrow = RAM[(vAC[0] < D) ? ONE_CONST_ADDRESS : ZERO_CONST_ADDRESS];
+                vAC[0] = uint8_t(vAC[0] - D);
+                vAC[1] = uint8_t(vAC[1] - borrow);
+            }
+            break;
+
+            case LSLW:
+            {
+                uint8_t carry = RAM[(vAC[0] & 0x80) ? ONE_CONST_ADDRESS : ZERO_CONST_ADDRESS];
+                vAC[0] = uint8_t(vAC[0] <<1);
+                vAC[1] = uint8_t((vAC[1] <<1) + carry);
+                nextL = uint8_t(pcL + 1 - 2);
+            }
+            break;
+
+            case INC:  RAM[D]++;                                                    break;
+            case ANDI: vAC[0] &= D, vAC[1] = 0;                                     break;
+            case ORI:  vAC[0] |= D;                                                 break;
+            case XORI: vAC[0] ^= D;                                                 break;
+            case ALLOC: RAM[HLE_VSP] = uint8_t(RAM[HLE_VSP] + D);                   break;
+            case BRA:  nextL = D;                                                   break;
+
+            case PEEK:
+            {
+                vAC[0] = RAM[AC & maskRAM];
+                vAC[1] = 0;
+                nextL = uint8_t(pcL + 1 - 2);
+            }
+            break;
+
+            // Both bytes come from the same page, (X++)
+            case DEEK:
+            {
+                vAC[0] = RAM[AC & maskRAM];
+                vAC[1] = RAM[MAKE_ADDR(HI_BYTE(AC), AC + 1) & maskRAM];
+                nextL = uint8_t(pcL + 1 - 2);
+            }
+            break;
+
+            case POKE:
+            case DOKE:
+            {
+                RAM[HLE_VTMP] = D;
+                uint16_t addr = RAM[D] | (RAM[uint8_t(D + 1)] <<8);
+                RAM[addr & maskRAM] = vAC[0];
+                if(opcode == DOKE) RAM[MAKE_ADDR(HI_BYTE(addr), addr + 1) & maskRAM] = vAC[1];
+            }
+            break;
+
+            case BCC:
+            {
+                uint8_t target = RAM[MAKE_ADDR(pcH, pcL + 2) & maskRAM];
+                bool taken = false;
+                switch(D)
+                {
+                    case CondEQ: taken = (AC == 0);          break;
+                    case CondNE: taken = (AC != 0);          break;
+                    case CondGT: taken = (int16_t(AC) > 0);  break;
+                    case CondLT: taken = (int16_t(AC) < 0);  break;
+                    case CondGE: taken = (int16_t(AC) >= 0); break;
+                    case CondLE: taken = (int16_t(AC) <= 0); break;
+
+                    default: break;
+                }
+                RAM[HLE_VTMP] = (vAC[1]) ? vAC[1] : (vAC[0]) ? 1 : 0;
+                nextL = (taken) ? target : uint8_t(pcL + 3 - 2);
+            }
+            break;
+
+            case CALL:
+            case CALLI:
+            {
+                uint16_t target = (opcode == CALL) ? RAM[D] | (RAM[uint8_t(D + 1)] <<8) : D | (RAM[MAKE_ADDR(pcH, pcL + 2) & maskRAM] <<8);
+                if(opcode == CALL) RAM[HLE_VTMP] = D;
+                RAM[HLE_VLR] = uint8_t(pcL + ((opcode == CALL) ? 2 : 3));
+                RAM[HLE_VLR + 1] = pcH;
+                RAM[HLE_VPC + 1] = HI_BYTE(target);
+                nextL = uint8_t(target - 2);
+            }
+            break;
+
+            case RET:
+            {
+                RAM[HLE_VPC + 1] = RAM[HLE_VLR + 1];
+                nextL = uint8_t(RAM[HLE_VLR] - 2);
+            }
+            break;
+
+            case PUSH:
+            {
+                uint8_t vSP = RAM[HLE_VSP];
+                RAM[uint8_t(vSP - 1)] = RAM[HLE_VLR + 1];
+                RAM[uint8_t(vSP - 2)] = RAM[HLE_VLR];
+                RAM[HLE_VSP] = uint8_t(vSP - 2);
+                nextL = uint8_t(pcL + 1 - 2);
+            }
+            break;
+
+            case POP:
+            {
+                uint8_t vSP = RAM[HLE_VSP];
+                RAM[HLE_VLR] = RAM[vSP];
+                RAM[HLE_VLR + 1] = RAM[uint8_t(vSP + 1)];
+                RAM[HLE_VSP] = uint8_t(vSP + 2);
+                nextL = uint8_t(pcL + 1 - 2);
+            }
+            break;
+
+            case DEF:
+            {
+                RAM[HLE_VTMP] = D;
+                vAC[0] = uint8_t(pcL + 2);
+                vAC[1] = pcH;
+                nextL = D;
+            }
+            break;
+
+            // The high byte is nudged so that a following SUBW gives the right sign, only when the signs differ
+            case CMPHS:
+            case CMPHU:
+            {
+                uint8_t W = RAM[D];
+                if(((W ^ vAC[1]) & 0x80) == 0)
+                {
+                    cost = 22;
+                    break;
+                }
+                bool vacNegative = (vAC[1] & 0x80) != 0;
+                int8_t adjust = (opcode == CMPHS) ? ((vacNegative) ? -1 : +1) : ((vacNegative) ? +1 : -1);
+                vAC[1] = uint8_t(W + adjust);
+            }
+            break;
+
+            default: return 0;
+        }
+
+        if(nextL != pcL) RAM[HLE_VPC] = nextL;
+
+        return cost;
+    }
+}
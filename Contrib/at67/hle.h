@@ -0,0 +1,28 @@
+#ifndef HLE_H
+#define HLE_H
+
+#include <stdint.h>
+
+
+// vCPU zero page registers
+#define HLE_VTICKS 0x0015
+#define HLE_VPC    0x0016
+#define HLE_VAC    0x0018
+#define HLE_VLR    0x001A
+#define HLE_VSP    0x001C
+
+#define HLE_MAX_CYCLES 28 // slowest instruction that is emulated
+
+
+// High level emulation of the vCPU, one instruction at a time directly against RAM, the ROM's interpreter is bypassed and the time it
+// would have taken comes from a per instruction cost table, (cycles from NEXT back to NEXT, so that the vTicks budget stays exact)
+// Anything not implemented here, (SYS, LUP, unknown opcodes), returns zero so that the native interpreter can run it instead
+namespace Hle
+{
+    enum InstructionSet {vCpuV1=0, vCpuV5a, NumInstructionSets};
+
+    // vPC is the address of the instruction, (i.e. after NEXT's increment), vPC only ever advances within it's page, as in the ROM
+    int execute(uint8_t* RAM, uint16_t maskRAM, uint16_t vPC, InstructionSet instructionSet);
+}
+
+#endif
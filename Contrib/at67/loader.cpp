@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string>
 #include <fstream>
+#include <chrono>
 #include <algorithm>
 #include <string.h>
 
@@ -28,6 +29,7 @@
 #include "graphics.h"
 #include "inih/INIReader.h"
 #include "rs232/rs232.h"
+#include "replay.h"
 #endif
 
 #include "memory.h"
@@ -52,7 +54,7 @@ namespace Loader
 
     std::string _exePath = ".";
     std::string _cwdPath = ".";
-    std::string _filePath = ".";
+    thread_local std::string _filePath = ".";
 
 
     const std::string& getExePath(void) {return _exePath;}
@@ -244,7 +246,7 @@ namespace Loader
         return true;
     }
 
-    uint16_t printGt1Stats(const std::string& filename, const Gt1File& gt1File, bool isGbasFile)
+    uint16_t printGt1Stats(const std::string& filename, const Gt1File& gt1File, bool isGbasFile, int sizeRAM)
     {
         size_t nameSuffix = filename.find_last_of(".");
         std::string output = filename.substr(0, nameSuffix) + ".gt1";
@@ -259,7 +261,7 @@ namespace Loader
             {
                 uint16_t address = gt1File._segments[i]._loAddress + (gt1File._segments[i]._hiAddress <<8);
                 uint16_t segmentSize = (gt1File._segments[i]._segmentSize == 0) ? 256 : gt1File._segments[i]._segmentSize;
-                if((address + segmentSize - 1) < Memory::getSizeRAM()  &&  !Memory::isVideoRAM(address)) totalSize += segmentSize;
+                if((address + segmentSize - 1) < sizeRAM  &&  !Memory::isVideoRAM(address)) totalSize += segmentSize;
                 if((address & 0x00FF) + segmentSize > 256) fprintf(stderr, "Loader::printGt1Stats() : Page overflow, (ignore if non code segment), segment %d : address 0x%04x : segmentSize %3d\n", i, address, segmentSize);
             }
         }
@@ -326,10 +328,11 @@ namespace Loader
             }
         }
 #endif
-        if(!isGbasFile) Memory::setSizeFreeRAM(Memory::getBaseFreeRAM() - totalSize); 
+        // BASIC's free RAM comes from the compiler's allocator
+        int freeRAM = (isGbasFile) ? Memory::getSizeFreeRAM() : std::max(sizeRAM - RAM_USED_DEFAULT - totalSize, 0);
 
         fprintf(stderr, "**********************************************\n");
-        fprintf(stderr, "* Free RAM after load  :  %5d\n", Memory::getSizeFreeRAM());
+        fprintf(stderr, "* Free RAM after load  :  %5d\n", freeRAM);
         fprintf(stderr, "**********************************************\n");
 
         return totalSize;
@@ -341,7 +344,8 @@ namespace Loader
     enum FrameState {Resync=0, Frame, Execute, NumFrameStates};
 
 
-    UploadTarget _uploadTarget = None;
+    // Per thread, so that each emulator instance in a thread pool has it's own pending upload and game
+    thread_local UploadTarget _uploadTarget = None;
     bool _disableUploads = false;
 
     int _gt1UploadSize = 0;
@@ -361,7 +365,7 @@ namespace Loader
 
     std::vector<ConfigRom> _configRoms;
 
-    std::string _currentGame = "";
+    thread_local std::string _currentGame = "";
 
     INIReader _configIniReader;
     INIReader _highScoresIniReader;
@@ -622,7 +626,7 @@ namespace Loader
     {
         line.clear();
         char buffer = 0;
-        uint64_t prevFrameCounter = SDL_GetPerformanceCounter();
+        auto prevTime = std::chrono::steady_clock::now();
 
         while(buffer != '\n')
         {
@@ -630,8 +634,8 @@ namespace Loader
             {
                 if((buffer >= 32  &&  buffer <= 126)  ||  buffer == '\n') line.push_back(buffer);
             }
-            double frameTime = double(SDL_GetPerformanceCounter() - prevFrameCounter) / double(SDL_GetPerformanceFrequency());
-            if(frameTime > _configTimeOut) return false;
+            std::chrono::duration<double> frameTime = std::chrono::steady_clock::now() - prevTime;
+            if(frameTime.count() > _configTimeOut) return false;
         }
 
         // Replace '\n'
@@ -793,7 +797,11 @@ namespace Loader
         Graphics::setUploadFilename(filename);
 
         _gt1UploadSize = int(gt1file.gcount());
+#ifndef HEADLESS
         SDL_CreateThread(uploadToGigaThread, VERSION_STR, (void*)&_gt1UploadSize);
+#else
+        uploadToGigaThread((void*)&_gt1UploadSize);
+#endif
     }
 
     void disableUploads(bool disable)
@@ -1136,7 +1144,7 @@ namespace Loader
             if(LO_BYTE(endAddress) < LO_BYTE(GTB_LINE0_ADDRESS)) endAddress = HI_MASK(endAddress) | LO_BYTE(GTB_LINE0_ADDRESS);
         }
 
-        uint16_t freeMemory = uint16_t(Memory::getFreeGtbRAM(int(lines.size())));
+        uint16_t freeMemory = uint16_t(Memory::getFreeGtbRAM(int(lines.size()), Cpu::getSizeRAM()));
         fprintf(stderr, "Loader::loadGtbFile() : start %04x : end %04x : free %d : '%s'\n", startAddress, endAddress, freeMemory, filepath.c_str());
 
         Cpu::setRAM(GTB_LINE0_ADDRESS + 0, LO_BYTE(endAddress));
@@ -1180,20 +1188,21 @@ namespace Loader
         // Choose memory model
         if(_autoSet64k  &&  (filename.find("64k") != std::string::npos  ||  filename.find("64K") != std::string::npos))
         {
-            if(Memory::getSizeRAM() == RAM_SIZE_LO)
+            if(Cpu::getSizeRAM() == RAM_SIZE_LO)
             {
-                Memory::setSizeRAM(RAM_SIZE_HI);
-                Memory::initialise();
-                Cpu::setSizeRAM(Memory::getSizeRAM());
+                Cpu::setSizeRAM(RAM_SIZE_HI);
                 Cpu::setRAM(0x0001, 0x00); // inform system that RAM is 64k
             }
         }
 
+        // The calling thread's instance decides the memory model, the compiler and loader are shared by all instances
+        int sizeRAM = Cpu::getSizeRAM();
+
         // Compile gbas to gasm
         if(filename.find(".gbas") != filename.npos)
         {
             std::string output = filepath.substr(0, pathSuffix) + ".gasm";
-            if(!Compiler::compile(filepath, output)) return;
+            if(!Compiler::compile(filepath, output, sizeRAM)) return;
 
             // Create gasm name and path
             filename = filename.substr(0, nameSuffix) + ".gasm";
@@ -1269,7 +1278,7 @@ namespace Loader
                 {
                     // Ignore if address will not fit in current RAM
                     uint16_t address = gt1File._segments[j]._loAddress + (gt1File._segments[j]._hiAddress <<8);
-                    if((address + int(gt1File._segments[j]._dataBytes.size()) - 1) < Memory::getSizeRAM())
+                    if((address + int(gt1File._segments[j]._dataBytes.size()) - 1) < sizeRAM)
                     {
                         for(int i=0; i<int(gt1File._segments[j]._dataBytes.size()); i++)
                         {
@@ -1339,7 +1348,7 @@ namespace Loader
                     }
                     else
                     {
-                        if(address < Memory::getSizeRAM()) Cpu::setRAM(address++, byteCode._data);
+                        if(address < sizeRAM) Cpu::setRAM(address++, byteCode._data);
                     }
                 }
                 gt1Segment._dataBytes.push_back(byteCode._data);
@@ -1376,7 +1385,10 @@ namespace Loader
         else if(uploadTarget == Hardware) fprintf(stderr, "\nTarget : Gigatron");
 
         // BASIC calculates the correct value of free RAM as part of the compilation
-        printGt1Stats(filename, gt1File, isGbasFile);
+        uint16_t totalSize = printGt1Stats(filename, gt1File, isGbasFile, sizeRAM);
+
+        // Only the interactive instance has a free RAM readout
+        if(uploadTarget == Emulator  &&  !isGbasFile  &&  Cpu::getEmulator()->_hostOutput) Memory::setSizeFreeRAM(sizeRAM - RAM_USED_DEFAULT - totalSize);
 
         if(uploadTarget == Emulator)
         {
@@ -1453,8 +1465,9 @@ namespace Loader
 
     bool sendFrame(int vgaY, uint8_t firstByte, uint8_t* message, uint8_t len, uint16_t address, uint8_t& checksum)
     {
-        static LoaderState loaderState = LoaderState::FirstByte;
-        static uint8_t payload[PAYLOAD_SIZE];
+        UploadState& state = Cpu::getEmulator()->_machine._upload;
+        int& loaderState = state._loaderState;
+        uint8_t* payload = state._payload;
 
         bool sending = true;
 
@@ -1504,7 +1517,7 @@ namespace Loader
 
             case LoaderState::Message: // 8*PAYLOAD_SIZE bits
             {
-                static int msgIdx = 0;
+                int& msgIdx = state._msgIdx;
                 if(vgaY == VSYNC_START+38+msgIdx*8)
                 {
                     sendByte(payload[msgIdx], checksum);
@@ -1549,9 +1562,10 @@ namespace Loader
     // TODO: fix the Gigatron version of upload so that it can send more than 60 total bytes, (i.e. break up the payload into multiple packets of 60, 1 packet per frame)
     void upload(int vgaY)
     {
-        static bool frameUploading = false;
-        static uint8_t payload[RAM_SIZE_HI];
-        static uint8_t payloadSize = 0;
+        UploadState& state = Cpu::getEmulator()->_machine._upload;
+        bool& frameUploading = state._frameUploading;
+        uint8_t* payload = state._framePayload;
+        uint8_t payloadSize = state._payloadSize;
 
         if(_uploadTarget != None  ||  frameUploading)
         {
@@ -1565,6 +1579,16 @@ namespace Loader
 
                 //fprintf(stderr, "\nLoader::upload() : %s\n", _filePath.c_str());
 
+                // Uploads into a replaying emulator come from the recording only
+                if(Replay::getMode() == Replay::Replaying)
+                {
+                    _uploadTarget = None;
+                    return;
+                }
+                if(_uploadTarget == Emulator) Replay::recordUpload(_filePath);
+
+                // The assembler and compiler are shared by all emulator instances
+                std::lock_guard<std::recursive_mutex> lock(Cpu::getSharedMutex());
                 uploadDirect(_uploadTarget, _filePath);
                 _uploadTarget = None;
 
@@ -1572,8 +1596,8 @@ namespace Loader
             }
 
             frameUploading = true;            
-            static uint8_t checksum = 0;
-            static FrameState frameState = FrameState::Resync;
+            uint8_t& checksum = state._checksum;
+            int& frameState = state._frameState;
             switch(frameState)
             {
                 case FrameState::Resync:
@@ -42,6 +42,19 @@ namespace Loader
         uint8_t _loStart=DEFAULT_START_ADDRESS_LO;
     };
 
+    // Emulated loader protocol state machine, owned by each emulator instance
+    struct UploadState
+    {
+        int _loaderState = 0;
+        int _frameState = 0;
+        int _msgIdx = 0;
+        bool _frameUploading = false;
+        uint8_t _checksum = 0;
+        uint8_t _payloadSize = 0;
+        uint8_t _payload[PAYLOAD_SIZE];
+        uint8_t _framePayload[PAYLOAD_SIZE];
+    };
+
     const std::string& getExePath(void);
     const std::string& getCwdPath(void);
     const std::string& getFilePath(void);
@@ -50,7 +63,7 @@ namespace Loader
 
     bool loadGt1File(const std::string& filename, Gt1File& gt1File);
     bool saveGt1File(const std::string& filepath, Gt1File& gt1File, std::string& filename);
-    uint16_t printGt1Stats(const std::string& filename, const Gt1File& gt1File, bool isGbasFile);
+    uint16_t printGt1Stats(const std::string& filename, const Gt1File& gt1File, bool isGbasFile, int sizeRAM);
 
 #ifdef _WIN32
     char* getcwd(char* dst, int size);
@@ -9,12 +9,15 @@
 /*******************************************************************************/
 
 
+#include <thread>
+
 #include "memory.h"
 #include "cpu.h"
 #include "audio.h"
 #include "editor.h"
 #include "loader.h"
 #include "timing.h"
+#include "rewind.h"
 #include "image.h"
 #include "graphics.h"
 #include "terminal.h"
@@ -28,6 +31,35 @@
 #include "linker.h"
 
 
+// Everything but presentation, (emulation, input handling, the editor, drawing and timing)
+void emulate(void)
+{
+    while(1)
+    {
+        switch(Editor::getEditorMode())
+        {
+            case Editor::Term:
+            {
+                Terminal::process();
+            }
+            break;
+
+            case Editor::Image:
+            {
+                Image::process();
+            }
+            break;
+
+            // Emulate a frame at a time, returning at vSync so that editor mode changes are picked up
+            default:
+            {
+                Cpu::runUntil(CLOCK_FREQ/VSYNC_RATE, Cpu::RunVSync);
+            }
+            break;
+        }
+    }
+}
+
 int main(int argc, char* argv[])
 {
     if(argc != 1  &&  argc != 2)
@@ -43,6 +75,7 @@ int main(int argc, char* argv[])
     Audio::initialise();
     Image::initialise();
     Editor::initialise();
+    Rewind::initialise();
     Graphics::initialise();
     Terminal::initialise();
     Expression::initialise();
@@ -74,12 +107,7 @@ int main(int argc, char* argv[])
         // Choose memory model
         if(name.find("64k") != std::string::npos  ||  name.find("64K") != std::string::npos)
         {
-            if(Memory::getSizeRAM() == RAM_SIZE_LO)
-            {
-                Memory::setSizeRAM(RAM_SIZE_HI);
-                Memory::initialise();
-                Cpu::setSizeRAM(Memory::getSizeRAM());
-            }
+            Cpu::setSizeRAM(RAM_SIZE_HI);
         }
     }
 
@@ -124,29 +152,9 @@ int main(int argc, char* argv[])
 #endif
 #endif
 
-    while(1)
-    {
-        switch(Editor::getEditorMode())
-        {
-            case Editor::Term:
-            {
-                Terminal::process();
-            }
-            break;
-
-            case Editor::Image:
-            {
-                Image::process();
-            }
-            break;
-
-            default:
-            {
-                Cpu::process();
-            }
-            break;
-        }
-    }
+    // The emulation runs on it's own thread, this one only presents it's frames and forwards input to it
+    std::thread emulation(emulate);
+    Graphics::present();
 
     return 0;
 }
\ No newline at end of file
@@ -19,10 +19,10 @@ namespace Memory
     int getSizeRAM(void) {return _sizeRAM;}
     int getBaseFreeRAM(void) {return _baseFreeRAM;}
     int getSizeFreeRAM(void) {return _sizeFreeRAM;}
-    int getFreeGtbRAM(int numLines)
+    int getFreeGtbRAM(int numLines, int sizeRAM)
     {
         int free = ((0x80 - HI_BYTE(GTB_LINE0_ADDRESS))*NUM_GTB_LINES_PER_ROW - numLines)*MAX_GTB_LINE_SIZE - MAX_GTB_LINE_SIZE;
-        if(_sizeRAM == RAM_SIZE_HI) free += RAM_EXPANSION_SIZE;
+        if(sizeRAM == RAM_SIZE_HI) free += RAM_EXPANSION_SIZE;
         return free;
     }
 
@@ -65,7 +65,7 @@ namespace Memory
     int getSizeRAM(void);
     int getBaseFreeRAM(void);
     int getSizeFreeRAM(void);
-    int getFreeGtbRAM(int numLines);
+    int getFreeGtbRAM(int numLines, int sizeRAM);
 
     void setSizeRAM(int sizeRAM);
     void setSizeFreeRAM(int freeRAM);
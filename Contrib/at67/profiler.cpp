@@ -0,0 +1,575 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+
+#include "cpu.h"
+#include "assembler.h"
+#include "profiler.h"
+
+
+#define VCPU_ADDRESS_SPACE   0x10000
+#define NATIVE_ADDRESS_SPACE 0x10000
+
+
+namespace Profiler
+{
+    struct Symbol
+    {
+        uint16_t _address;
+        std::string _name;
+    };
+
+    struct Hotspot
+    {
+        uint16_t _vPC;
+        int _symbol;
+        uint64_t _instructions;
+        uint64_t _cycles;
+    };
+
+    // Per thread, like the emulator instance being profiled
+    thread_local bool _vCpuEnabled = false;
+    thread_local bool _vCpuPending = false;
+    thread_local uint16_t _vCpuPC = 0x0000;
+    thread_local int64_t _vCpuClock = 0;
+
+    thread_local std::vector<uint64_t> _vCpuInstructions;
+    thread_local std::vector<uint64_t> _vCpuCycles;
+
+    thread_local bool _nativeEnabled = false;
+    thread_local uint64_t _nativeFrames = 0;
+    thread_local std::vector<uint64_t> _nativeCycles;
+    thread_local std::vector<Symbol> _nativeSymbols;
+    thread_local std::string _nativeListing;
+
+    thread_local bool _mixEnabled = false;
+    thread_local uint64_t _mixOpcodes[256];
+    thread_local uint64_t _mixTaken[8];
+    thread_local uint64_t _mixNotTaken[8];
+
+    const char* _mixOperations[8] = {"ld", "anda", "ora", "xora", "adda", "suba", "st", "jump"};
+    const char* _mixAddressModes[8] = {"[D],AC", "[X],AC", "[Y,D],AC", "[Y,X],AC", "[D],X", "[D],Y", "[D],OUT", "[Y,X++],OUT"};
+    const char* _mixBusModes[4] = {"D", "RAM", "AC", "IN"};
+    const char* _mixBranches[8] = {"jmp", "bgt", "blt", "bne", "beq", "bge", "ble", "bra"};
+
+
+    bool getVCpuEnabled(void) {return _vCpuEnabled;}
+
+    void setVCpuEnabled(bool enabled)
+    {
+        if(enabled  &&  _vCpuInstructions.empty())
+        {
+            _vCpuInstructions.resize(VCPU_ADDRESS_SPACE, 0);
+            _vCpuCycles.resize(VCPU_ADDRESS_SPACE, 0);
+        }
+
+        _vCpuPending = false;
+        _vCpuEnabled = enabled;
+    }
+
+    void resetVCpu(void)
+    {
+        std::fill(_vCpuInstructions.begin(), _vCpuInstructions.end(), 0);
+        std::fill(_vCpuCycles.begin(), _vCpuCycles.end(), 0);
+        _vCpuPending = false;
+    }
+
+    bool getNativeEnabled(void) {return _nativeEnabled;}
+    uint64_t* getNativeCycles(void) {return (_nativeCycles.empty()) ? nullptr : &_nativeCycles[0];}
+
+    void setNativeEnabled(bool enabled)
+    {
+        if(enabled  &&  _nativeCycles.empty()) _nativeCycles.resize(NATIVE_ADDRESS_SPACE, 0);
+
+        _nativeEnabled = enabled;
+    }
+
+    void resetNative(void)
+    {
+        std::fill(_nativeCycles.begin(), _nativeCycles.end(), 0);
+        _nativeFrames = 0;
+    }
+
+    void nativeVSync(void)
+    {
+        _nativeFrames++;
+    }
+
+    void vCpuDispatch(uint16_t vPC, int64_t clock)
+    {
+        _vCpuInstructions[vPC]++;
+        _vCpuPC = vPC;
+        _vCpuClock = clock;
+        _vCpuPending = true;
+    }
+
+    void vCpuNext(int64_t clock)
+    {
+        if(!_vCpuPending) return;
+        _vCpuPending = false;
+
+        // Clock can go backwards through a rewind or snapshot restore
+        if(clock < _vCpuClock) return;
+
+        _vCpuCycles[_vCpuPC] += uint64_t(clock - _vCpuClock) + PROFILER_VCPU_FETCH_CYCLES;
+    }
+
+
+    void sortSymbols(std::vector<Symbol>& symbols)
+    {
+        std::stable_sort(symbols.begin(), symbols.end(), [](const Symbol& a, const Symbol& b) {return a._address < b._address;});
+    }
+
+    // Labels of the most recently assembled file, (gtBASIC line numbers are labels in the .gasm the compiler produces), sorted by address
+    void getVCpuSymbols(std::vector<Symbol>& symbols)
+    {
+        std::lock_guard<std::recursive_mutex> lock(Cpu::getSharedMutex());
+
+        symbols.clear();
+        for(int i=0; i<Assembler::getLabelsSize(); i++)
+        {
+            Assembler::Label* label = Assembler::getLabel(i);
+            symbols.push_back({label->_address, label->_name});
+        }
+
+        sortSymbols(symbols);
+    }
+
+    // Closest label at or below the address, -1 if there isn't one
+    int findSymbol(const std::vector<Symbol>& symbols, uint16_t address)
+    {
+        auto it = std::upper_bound(symbols.begin(), symbols.end(), address, [](uint16_t addr, const Symbol& symbol) {return addr < symbol._address;});
+        return (it == symbols.begin()) ? -1 : int(it - symbols.begin()) - 1;
+    }
+
+    std::string getSymbolName(const std::vector<Symbol>& symbols, int symbol)
+    {
+        return (symbol < 0) ? std::string("?") : symbols[symbol]._name;
+    }
+
+    void getHotspots(const std::vector<Symbol>& symbols, std::vector<Hotspot>& hotspots, uint64_t& totalCycles)
+    {
+        hotspots.clear();
+        totalCycles = 0;
+        for(int i=0; i<int(_vCpuInstructions.size()); i++)
+        {
+            if(_vCpuInstructions[i] == 0) continue;
+
+            hotspots.push_back({uint16_t(i), findSymbol(symbols, uint16_t(i)), _vCpuInstructions[i], _vCpuCycles[i]});
+            totalCycles += _vCpuCycles[i];
+        }
+
+        std::stable_sort(hotspots.begin(), hotspots.end(), [](const Hotspot& a, const Hotspot& b) {return a._cycles > b._cycles;});
+    }
+
+    // Report is CSV if the filename ends in .csv, otherwise it is text with a per symbol summary followed by the individual vPC's
+    bool saveVCpuReport(const std::string& filename)
+    {
+        if(_vCpuInstructions.empty())
+        {
+            fprintf(stderr, "Profiler::saveVCpuReport() : vCPU profiling has not been enabled\n");
+            return false;
+        }
+
+        std::ofstream outfile(filename);
+        if(!outfile.is_open())
+        {
+            fprintf(stderr, "Profiler::saveVCpuReport() : failed to create '%s'\n", filename.c_str());
+            return false;
+        }
+
+        std::vector<Symbol> symbols;
+        getVCpuSymbols(symbols);
+
+        uint64_t totalCycles;
+        std::vector<Hotspot> hotspots;
+        getHotspots(symbols, hotspots, totalCycles);
+        double scale = (totalCycles) ? 100.0 / double(totalCycles) : 0.0;
+
+        char line[256];
+        bool csv = filename.size() >= 4  &&  filename.substr(filename.size() - 4) == ".csv";
+        if(csv)
+        {
+            outfile << "vPC,symbol,offset,instructions,cycles,percent\n";
+            for(int i=0; i<int(hotspots.size()); i++)
+            {
+                const Hotspot& h = hotspots[i];
+                int offset = (h._symbol < 0) ? 0 : h._vPC - symbols[h._symbol]._address;
+                snprintf(line, sizeof(line), "0x%04x,%s,%d,%" PRIu64 ",%" PRIu64 ",%0.3f\n", h._vPC, getSymbolName(symbols, h._symbol).c_str(), offset, h._instructions, h._cycles, double(h._cycles)*scale);
+                outfile << line;
+            }
+        }
+        else
+        {
+            // Per symbol totals
+            std::vector<Hotspot> totals;
+            for(int i=0; i<int(hotspots.size()); i++)
+            {
+                auto it = std::find_if(totals.begin(), totals.end(), [&](const Hotspot& t) {return t._symbol == hotspots[i]._symbol;});
+                if(it == totals.end())
+                {
+                    totals.push_back(hotspots[i]);
+                    continue;
+                }
+
+                it->_instructions += hotspots[i]._instructions;
+                it->_cycles += hotspots[i]._cycles;
+            }
+            std::stable_sort(totals.begin(), totals.end(), [](const Hotspot& a, const Hotspot& b) {return a._cycles > b._cycles;});
+
+            snprintf(line, sizeof(line), "vCPU profile : %" PRIu64 " cycles\n\n", totalCycles);
+            outfile << line;
+            snprintf(line, sizeof(line), "%-32s %14s %14s %8s\n", "Symbol", "Instructions", "Cycles", "%");
+            outfile << line;
+            for(int i=0; i<int(totals.size()); i++)
+            {
+                snprintf(line, sizeof(line), "%-32s %14" PRIu64 " %14" PRIu64 " %8.3f\n", getSymbolName(symbols, totals[i]._symbol).c_str(), totals[i]._instructions, totals[i]._cycles, double(totals[i]._cycles)*scale);
+                outfile << line;
+            }
+
+            snprintf(line, sizeof(line), "\n%-6s %-32s %14s %14s %8s\n", "vPC", "Symbol", "Instructions", "Cycles", "%");
+            outfile << line;
+            for(int i=0; i<int(hotspots.size()); i++)
+            {
+                const Hotspot& h = hotspots[i];
+                std::string name = getSymbolName(symbols, h._symbol);
+                if(h._symbol >= 0  &&  h._vPC != symbols[h._symbol]._address)
+                {
+                    snprintf(line, sizeof(line), "+0x%x", h._vPC - symbols[h._symbol]._address);
+                    name += line;
+                }
+                snprintf(line, sizeof(line), "0x%04x %-32s %14" PRIu64 " %14" PRIu64 " %8.3f\n", h._vPC, name.c_str(), h._instructions, h._cycles, double(h._cycles)*scale);
+                outfile << line;
+            }
+        }
+
+        if(outfile.bad() || outfile.fail())
+        {
+            fprintf(stderr, "Profiler::saveVCpuReport() : write error in '%s'\n", filename.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    // One '<symbol>;<vPC> <cycles>' line per vPC, the folded stack format that flamegraph.pl and speedscope read
+    bool saveVCpuFolded(const std::string& filename)
+    {
+        if(_vCpuInstructions.empty())
+        {
+            fprintf(stderr, "Profiler::saveVCpuFolded() : vCPU profiling has not been enabled\n");
+            return false;
+        }
+
+        std::ofstream outfile(filename);
+        if(!outfile.is_open())
+        {
+            fprintf(stderr, "Profiler::saveVCpuFolded() : failed to create '%s'\n", filename.c_str());
+            return false;
+        }
+
+        std::vector<Symbol> symbols;
+        getVCpuSymbols(symbols);
+
+        uint64_t totalCycles;
+        std::vector<Hotspot> hotspots;
+        getHotspots(symbols, hotspots, totalCycles);
+
+        char line[256];
+        for(int i=0; i<int(hotspots.size()); i++)
+        {
+            if(hotspots[i]._cycles == 0) continue;
+
+            snprintf(line, sizeof(line), "vCPU;%s;0x%04x %" PRIu64 "\n", getSymbolName(symbols, hotspots[i]._symbol).c_str(), hotspots[i]._vPC, hotspots[i]._cycles);
+            outfile << line;
+        }
+
+        if(outfile.bad() || outfile.fail())
+        {
+            fprintf(stderr, "Profiler::saveVCpuFolded() : write error in '%s'\n", filename.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+
+    // Native listings are named after the ROM, (ROMv1.lst through ROMv5a.lst), and live at the root of the gigatron-rom repo
+    std::string getNativeListingName(void)
+    {
+        switch(Cpu::getRomType())
+        {
+            case Cpu::ROMv1:  return std::string("ROMv1.lst");
+            case Cpu::ROMv2:  return std::string("ROMv2.lst");
+            case Cpu::ROMv3:  return std::string("ROMv3.lst");
+            case Cpu::ROMv4:  return std::string("ROMv4.lst");
+            case Cpu::ROMv5a: return std::string("ROMv5a.lst");
+
+            // The latest internal ROM identifies itself as a DEVROM
+            case Cpu::DEVROM: return std::string("ROMv5a.lst");
+
+            default: break;
+        }
+
+        return std::string("");
+    }
+
+    // Every line that starts with a label, (local '.' labels are skipped so that whole routines are reported), defines a symbol at
+    // the address of the first instruction that follows it, which is either on the same line or the next one
+    bool loadNativeSymbols(const std::string& filename)
+    {
+        std::string name = (filename.size()) ? filename : getNativeListingName();
+        if(name.empty())
+        {
+            fprintf(stderr, "Profiler::loadNativeSymbols() : no listing for the current ROM type\n");
+            return false;
+        }
+
+        std::ifstream infile(name);
+        if(!infile.is_open()  &&  filename.empty())
+        {
+            name = std::string(NATIVE_LISTING_PATH) + name;
+            infile.open(name);
+        }
+        if(!infile.is_open())
+        {
+            fprintf(stderr, "Profiler::loadNativeSymbols() : failed to open '%s'\n", name.c_str());
+            return false;
+        }
+
+        _nativeSymbols.clear();
+
+        int instructions = 0, mismatches = 0;
+        std::string line, label;
+        while(std::getline(infile, line))
+        {
+            size_t start = 0;
+            if(line.size()  &&  line[0] != ' '  &&  line[0] != '*')
+            {
+                size_t colon = line.find(':');
+                if(colon == std::string::npos) continue;
+
+                label = (line[0] == '.') ? std::string("") : line.substr(0, colon);
+                start = colon + 1;
+            }
+
+            // Address and encoding, 'aaaa eeee'
+            size_t pos = line.find_first_not_of(' ', start);
+            if(pos == std::string::npos  ||  pos + 9 > line.size()  ||  line[pos + 4] != ' ') continue;
+
+            char* endA;
+            char* endE;
+            std::string addressStr = line.substr(pos, 4), encodingStr = line.substr(pos + 5, 4);
+            uint16_t address = uint16_t(strtol(addressStr.c_str(), &endA, 16));
+            uint16_t encoding = uint16_t(strtol(encodingStr.c_str(), &endE, 16));
+            if(*endA  ||  *endE) continue;
+
+            // The listing must be of the ROM that is running, otherwise the routine names are meaningless
+            instructions++;
+            if(Cpu::getROM(address, 0) != HI_BYTE(encoding)  ||  Cpu::getROM(address, 1) != LO_BYTE(encoding)) mismatches++;
+
+            if(label.size()) _nativeSymbols.push_back({address, label});
+            label.clear();
+        }
+
+        // The emulator patches a handful of ROM locations, so only a listing that differs in more than 1% of it's instructions is suspect
+        if(mismatches*100 > instructions)
+        {
+            fprintf(stderr, "Profiler::loadNativeSymbols() : '%s' does not match the loaded ROM : %d of %d instructions differ\n", name.c_str(), mismatches, instructions);
+        }
+
+        sortSymbols(_nativeSymbols);
+        _nativeListing = name;
+
+        return true;
+    }
+
+    // Per routine totals and averages per frame, then the opcode mix
+    bool saveNativeReport(const std::string& filename)
+    {
+        if(_nativeCycles.empty())
+        {
+            fprintf(stderr, "Profiler::saveNativeReport() : native profiling has not been enabled\n");
+            return false;
+        }
+
+        std::ofstream outfile(filename);
+        if(!outfile.is_open())
+        {
+            fprintf(stderr, "Profiler::saveNativeReport() : failed to create '%s'\n", filename.c_str());
+            return false;
+        }
+
+        // The ROM type is only known once the ROM has booted, so the default listing is loaded as late as possible
+        if(_nativeListing.empty()) loadNativeSymbols();
+
+        uint64_t totalCycles = 0;
+        std::vector<Hotspot> totals(_nativeSymbols.size() + 1, {0x0000, -1, 0, 0});
+        std::vector<Hotspot> opcodes(256, {0x0000, -1, 0, 0});
+        for(int i=0; i<int(_nativeCycles.size()); i++)
+        {
+            if(_nativeCycles[i] == 0) continue;
+
+            int symbol = findSymbol(_nativeSymbols, uint16_t(i));
+            Hotspot& total = totals[symbol + 1];
+            total._symbol = symbol;
+            total._instructions++;
+            total._cycles += _nativeCycles[i];
+
+            uint8_t opcode = Cpu::getROM(uint16_t(i), 0);
+            opcodes[opcode]._vPC = opcode;
+            opcodes[opcode]._cycles += _nativeCycles[i];
+
+            totalCycles += _nativeCycles[i];
+        }
+        auto byCycles = [](const Hotspot& a, const Hotspot& b) {return a._cycles > b._cycles;};
+        std::stable_sort(totals.begin(), totals.end(), byCycles);
+        std::stable_sort(opcodes.begin(), opcodes.end(), byCycles);
+
+        double scale = (totalCycles) ? 100.0 / double(totalCycles) : 0.0;
+        double frames = double(std::max(_nativeFrames, uint64_t(1)));
+
+        char line[256];
+        snprintf(line, sizeof(line), "Native profile : %s : %" PRIu64 " cycles : %" PRIu64 " frames\n\n", _nativeListing.c_str(), totalCycles, _nativeFrames);
+        outfile << line;
+        snprintf(line, sizeof(line), "%-32s %10s %14s %14s %8s\n", "Routine", "PC's", "Cycles", "Cycles/frame", "%");
+        outfile << line;
+        for(int i=0; i<int(totals.size())  &&  totals[i]._cycles; i++)
+        {
+            snprintf(line, sizeof(line), "%-32s %10" PRIu64 " %14" PRIu64 " %14.1f %8.3f\n", getSymbolName(_nativeSymbols, totals[i]._symbol).c_str(), totals[i]._instructions,
+                                                                                                totals[i]._cycles, double(totals[i]._cycles)/frames, double(totals[i]._cycles)*scale);
+            outfile << line;
+        }
+
+        snprintf(line, sizeof(line), "\n%-6s %14s %8s\n", "Opcode", "Cycles", "%");
+        outfile << line;
+        for(int i=0; i<int(opcodes.size())  &&  opcodes[i]._cycles; i++)
+        {
+            snprintf(line, sizeof(line), "0x%02x   %14" PRIu64 " %8.3f\n", opcodes[i]._vPC, opcodes[i]._cycles, double(opcodes[i]._cycles)*scale);
+            outfile << line;
+        }
+
+        if(outfile.bad() || outfile.fail())
+        {
+            fprintf(stderr, "Profiler::saveNativeReport() : write error in '%s'\n", filename.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+
+    bool getMixEnabled(void) {return _mixEnabled;}
+    void setMixEnabled(bool enabled) {_mixEnabled = enabled;}
+
+    void resetMix(void)
+    {
+        memset(_mixOpcodes, 0, sizeof(_mixOpcodes));
+        memset(_mixTaken, 0, sizeof(_mixTaken));
+        memset(_mixNotTaken, 0, sizeof(_mixNotTaken));
+    }
+
+    // Called with the instruction register and accumulator of the state the instruction executed in
+    void mixInstruction(uint8_t IR, uint8_t AC)
+    {
+        _mixOpcodes[IR]++;
+        if((IR & 0xE0) != OPCODE_J) return;
+
+        bool taken = true;
+        int8_t ac = int8_t(AC);
+        switch(IR & BRA_CC_ALWAYS)
+        {
+            case BRA_CC_GT: taken = (ac >  0); break;
+            case BRA_CC_LT: taken = (ac <  0); break;
+            case BRA_CC_NE: taken = (ac != 0); break;
+            case BRA_CC_EQ: taken = (ac == 0); break;
+            case BRA_CC_GE: taken = (ac >= 0); break;
+            case BRA_CC_LE: taken = (ac <= 0); break;
+
+            default: break;
+        }
+
+        int mode = (IR >> 2) & 0x07;
+        if(taken) _mixTaken[mode]++; else _mixNotTaken[mode]++;
+    }
+
+    void writeJsonCounts(std::ofstream& outfile, const char* name, const char** keys, const uint64_t* counts, int size, bool last)
+    {
+        outfile << "  \"" << name << "\": {";
+        for(int i=0; i<size; i++) outfile << ((i) ? ", " : "") << "\"" << keys[i] << "\": " << counts[i];
+        outfile << ((last) ? "}\n" : "},\n");
+    }
+
+    // Machine readable, opcodes are listed individually and then broken down by operation, addressing mode and bus mode; jumps have
+    // no addressing mode, their mode bits are the condition, so they only appear in the branch section
+    bool saveMixJson(const std::string& filename)
+    {
+        std::ofstream outfile(filename);
+        if(!outfile.is_open())
+        {
+            fprintf(stderr, "Profiler::saveMixJson() : failed to create '%s'\n", filename.c_str());
+            return false;
+        }
+
+        uint64_t total = 0;
+        uint64_t operations[8] = {0}, addressModes[8] = {0}, busModes[4] = {0};
+        for(int i=0; i<256; i++)
+        {
+            total += _mixOpcodes[i];
+            operations[i >> 5] += _mixOpcodes[i];
+            busModes[i & 0x03] += _mixOpcodes[i];
+            if((i & 0xE0) != OPCODE_J) addressModes[(i >> 2) & 0x07] += _mixOpcodes[i];
+        }
+
+        char text[128];
+        outfile << "{\n";
+        std::string romType = "ROMERR";
+        Cpu::getRomTypeStr(Cpu::getRomType(), romType);
+        outfile << "  \"romType\": \"" << romType << "\",\n";
+        outfile << "  \"clock\": " << Cpu::getClock() << ",\n";
+        outfile << "  \"instructions\": " << total << ",\n";
+
+        outfile << "  \"opcodes\": [";
+        bool first = true;
+        for(int i=0; i<256; i++)
+        {
+            if(_mixOpcodes[i] == 0) continue;
+
+            const char* mode = ((i & 0xE0) == OPCODE_J) ? _mixBranches[(i >> 2) & 0x07] : _mixAddressModes[(i >> 2) & 0x07];
+            snprintf(text, sizeof(text), "%s\n    {\"opcode\": \"0x%02x\", \"operation\": \"%s\", \"mode\": \"%s\", \"bus\": \"%s\", \"count\": ", (first) ? "" : ",", i, _mixOperations[i >> 5], mode, _mixBusModes[i & 0x03]);
+            outfile << text << _mixOpcodes[i] << "}";
+            first = false;
+        }
+        outfile << "\n  ],\n";
+
+        writeJsonCounts(outfile, "operations", _mixOperations, operations, 8, false);
+        writeJsonCounts(outfile, "addressModes", _mixAddressModes, addressModes, 8, false);
+        writeJsonCounts(outfile, "busModes", _mixBusModes, busModes, 4, false);
+
+        outfile << "  \"branches\": {";
+        for(int i=0; i<8; i++)
+        {
+            uint64_t count = _mixTaken[i] + _mixNotTaken[i];
+            snprintf(text, sizeof(text), "%s\n    \"%s\": {\"taken\": ", (i) ? "," : "", _mixBranches[i]);
+            outfile << text << _mixTaken[i] << ", \"notTaken\": " << _mixNotTaken[i];
+            snprintf(text, sizeof(text), ", \"takenRatio\": %0.4f}", (count) ? double(_mixTaken[i]) / double(count) : 0.0);
+            outfile << text;
+        }
+        outfile << "\n  }\n";
+        outfile << "}\n";
+
+        if(outfile.bad() || outfile.fail())
+        {
+            fprintf(stderr, "Profiler::saveMixJson() : write error in '%s'\n", filename.c_str());
+            return false;
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <string>
+
+
+#define PROFILER_VCPU_FETCH_CYCLES 8 // NEXT up to and including the dispatch
+
+#define VCPU_PROFILE_REPORT   "vcpu_profile.txt"
+#define VCPU_PROFILE_FOLDED   "vcpu_profile.folded"
+#define NATIVE_PROFILE_REPORT "native_profile.txt"
+#define INSTRUCTION_MIX_JSON  "instruction_mix.json"
+
+// Where the ROMv*.lst listings are if they are not in the working directory, (Contrib/at67 relative to the repo root)
+#define NATIVE_LISTING_PATH "../../"
+
+
+// Hotspot profiling of the calling thread's emulator instance; every vCPU instruction dispatched is counted against it's vPC along
+// with the native cycles it took, from dispatch until the interpreter is back at NEXT, symbols come from the assembler's labels.
+// Native profiling counts every clock against the native PC, symbols come from the ROM's .lst listing. The instruction mix counts
+// every native instruction executed by opcode and whether each branch was taken, everything else is derived from the opcodes
+namespace Profiler
+{
+    bool getVCpuEnabled(void);
+    void setVCpuEnabled(bool enabled);
+
+    void resetVCpu(void);
+    void vCpuDispatch(uint16_t vPC, int64_t clock);
+    void vCpuNext(int64_t clock);
+
+    bool saveVCpuReport(const std::string& filename);
+    bool saveVCpuFolded(const std::string& filename);
+
+    bool getNativeEnabled(void);
+    uint64_t* getNativeCycles(void);
+    void setNativeEnabled(bool enabled);
+
+    void resetNative(void);
+    void nativeVSync(void);
+
+    std::string getNativeListingName(void);
+    bool loadNativeSymbols(const std::string& filename="");
+    bool saveNativeReport(const std::string& filename);
+
+    bool getMixEnabled(void);
+    void setMixEnabled(bool enabled);
+
+    void resetMix(void);
+    void mixInstruction(uint8_t IR, uint8_t AC);
+    bool saveMixJson(const std::string& filename);
+}
+
+#endif
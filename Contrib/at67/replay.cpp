@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+
+#include "cpu.h"
+#include "loader.h"
+#include "assembler.h"
+#include "replay.h"
+
+
+namespace Replay
+{
+    struct Event
+    {
+        int64_t _clock;
+        uint8_t _edge;
+        uint8_t _type;
+        uint8_t _in;
+        std::string _filepath;
+    };
+
+    // Per thread, so that every emulator instance in a thread pool can record or replay independently
+    thread_local Mode _mode = Off;
+    thread_local Edge _edge = VSyncEdge;
+    thread_local int64_t _prevClock = 0;
+
+    thread_local std::ofstream _outfile;
+    thread_local std::string _filename;
+
+    thread_local int _eventIndex = 0;
+    thread_local std::vector<Event> _events;
+
+
+    Mode getMode(void) {return _mode;}
+
+
+    // Events are a clock delta as an LEB128 varint, then the event type with the edge in bit 7, then the event's payload
+    void writeEvent(EventType type, const uint8_t* payload, int length)
+    {
+        int64_t clock = Cpu::getClock();
+        uint64_t delta = uint64_t(clock - _prevClock);
+        _prevClock = clock;
+
+        uint8_t buffer[16];
+        int count = 0;
+        do
+        {
+            uint8_t byte = delta & 0x7F;
+            delta >>= 7;
+            buffer[count++] = (delta) ? byte | 0x80 : byte;
+        }
+        while(delta);
+
+        buffer[count++] = uint8_t(type | (_edge <<7));
+        _outfile.write((char *)buffer, count);
+        if(length) _outfile.write((char *)payload, length);
+    }
+
+    bool readEvent(std::ifstream& infile, Event& event)
+    {
+        uint64_t delta = 0;
+        int shift = 0;
+        uint8_t byte;
+        do
+        {
+            if(!infile.read((char *)&byte, 1)  ||  shift > 63) return false;
+            delta |= uint64_t(byte & 0x7F) << shift;
+            shift += 7;
+        }
+        while(byte & 0x80);
+
+        uint8_t typeEdge;
+        if(!infile.read((char *)&typeEdge, 1)) return false;
+
+        _prevClock += int64_t(delta);
+        event._clock = _prevClock;
+        event._edge = typeEdge >> 7;
+        event._type = typeEdge & 0x7F;
+
+        switch(event._type)
+        {
+            case InEvent:  return bool(infile.read((char *)&event._in, 1));
+            case EndEvent: return true;
+
+            case UploadEvent:
+            {
+                uint8_t length[2];
+                if(!infile.read((char *)length, 2)) return false;
+                event._filepath.resize(length[0] | (length[1] <<8));
+                return event._filepath.empty()  ||  bool(infile.read(&event._filepath[0], event._filepath.size()));
+            }
+
+            default: break;
+        }
+
+        return false;
+    }
+
+    bool startRecording(const std::string& filename, uint32_t undefSeed)
+    {
+        if(_mode != Off)
+        {
+            fprintf(stderr, "Replay::startRecording() : already recording or replaying\n");
+            return false;
+        }
+
+        _outfile.open(filename, std::ios::binary | std::ios::out);
+        if(!_outfile.is_open())
+        {
+            fprintf(stderr, "Replay::startRecording() : failed to open '%s'\n", filename.c_str());
+            return false;
+        }
+
+        Cpu::Snapshot* snapshot = new (std::nothrow) Cpu::Snapshot;
+        if(!snapshot)
+        {
+            _outfile.close();
+            fprintf(stderr, "Replay::startRecording() : out of memory!\n");
+            return false;
+        }
+
+        // The undef generator is part of the machine, a non zero seed replaces it so that the same recording can be made twice
+        Cpu::Machine& machine = Cpu::getEmulator()->_machine;
+        if(undefSeed) machine._undefSeed = undefSeed;
+
+        ReplayHeader header;
+        header._undefSeed = machine._undefSeed;
+        header._startClock = machine._clock;
+        Cpu::takeSnapshot(*snapshot);
+
+        _outfile.write((char *)&header, sizeof(header));
+        _outfile.write((char *)snapshot, sizeof(Cpu::Snapshot));
+        delete snapshot;
+
+        if(_outfile.bad() || _outfile.fail())
+        {
+            _outfile.close();
+            fprintf(stderr, "Replay::startRecording() : write error in '%s'\n", filename.c_str());
+            return false;
+        }
+
+        _filename = filename;
+        _prevClock = header._startClock;
+        _mode = Recording;
+
+        return true;
+    }
+
+    bool stopRecording(void)
+    {
+        if(_mode != Recording) return false;
+
+        writeEvent(EndEvent, nullptr, 0);
+        _mode = Off;
+
+        bool success = !(_outfile.bad() || _outfile.fail());
+        if(!success) fprintf(stderr, "Replay::stopRecording() : write error in '%s'\n", _filename.c_str());
+        _outfile.close();
+
+        return success;
+    }
+
+    bool startReplaying(const std::string& filename)
+    {
+        if(_mode != Off)
+        {
+            fprintf(stderr, "Replay::startReplaying() : already recording or replaying\n");
+            return false;
+        }
+
+        std::ifstream infile(filename, std::ios::binary | std::ios::in);
+        if(!infile.is_open())
+        {
+            fprintf(stderr, "Replay::startReplaying() : failed to open '%s'\n", filename.c_str());
+            return false;
+        }
+
+        ReplayHeader header;
+        infile.read((char *)&header, sizeof(header));
+        if(infile.bad() || infile.fail()  ||  memcmp(header._name, REPLAY_IDENTIFIER, sizeof(header._name))  ||  header._version != REPLAY_VERSION)
+        {
+            fprintf(stderr, "Replay::startReplaying() : '%s' is not a valid replay file\n", filename.c_str());
+            return false;
+        }
+
+        Cpu::Snapshot* snapshot = new (std::nothrow) Cpu::Snapshot;
+        if(!snapshot)
+        {
+            fprintf(stderr, "Replay::startReplaying() : out of memory!\n");
+            return false;
+        }
+
+        infile.read((char *)snapshot, sizeof(Cpu::Snapshot));
+        bool success = !(infile.bad() || infile.fail())  &&  Cpu::restoreSnapshot(*snapshot);
+        delete snapshot;
+        if(!success)
+        {
+            fprintf(stderr, "Replay::startReplaying() : failed to restore the starting machine state from '%s'\n", filename.c_str());
+            return false;
+        }
+        Cpu::getEmulator()->_machine._undefSeed = header._undefSeed;
+
+        _events.clear();
+        _eventIndex = 0;
+        _prevClock = header._startClock;
+
+        Event event;
+        do
+        {
+            if(!readEvent(infile, event))
+            {
+                fprintf(stderr, "Replay::startReplaying() : '%s' is truncated or corrupt : after %d events\n", filename.c_str(), int(_events.size()));
+                return false;
+            }
+            _events.push_back(event);
+        }
+        while(event._type != EndEvent);
+
+        _mode = Replaying;
+
+        return true;
+    }
+
+    void stopReplaying(void)
+    {
+        _events.clear();
+        _eventIndex = 0;
+        _mode = Off;
+    }
+
+    // Called at every falling vSync and rising hSync edge, before the input and loader get their turn
+    void processEdge(Edge edge)
+    {
+        if(_mode == Recording)
+        {
+            _edge = edge;
+            return;
+        }
+
+        if(_mode != Replaying) return;
+
+        int64_t clock = Cpu::getClock();
+        while(_eventIndex < int(_events.size()))
+        {
+            const Event& event = _events[_eventIndex];
+            if(event._clock > clock  ||  (event._clock == clock  &&  event._edge != edge)) return;
+
+            if(event._clock < clock)
+            {
+                fprintf(stderr, "Replay::processEdge() : replay is out of sync at clock %" PRId64 " : stopping\n", clock);
+                stopReplaying();
+                return;
+            }
+
+            switch(event._type)
+            {
+                case InEvent: Cpu::getEmulator()->_machine._IN = event._in; break;
+
+                case UploadEvent:
+                {
+                    // Includes and the runtime are found relative to the uploaded file, as they were when it was recorded
+                    std::lock_guard<std::recursive_mutex> lock(Cpu::getSharedMutex());
+                    size_t slash = event._filepath.find_last_of("\\/");
+                    Assembler::setIncludePath((slash != std::string::npos) ? event._filepath.substr(0, slash) : ".");
+                    Loader::setFilePath(event._filepath);
+                    Loader::uploadDirect(Loader::Emulator, event._filepath);
+                }
+                break;
+
+                case EndEvent:
+                {
+                    fprintf(stderr, "Replay::processEdge() : replay finished at clock %" PRId64 "\n", clock);
+                    stopReplaying();
+                }
+                return;
+
+                default: break;
+            }
+
+            _eventIndex++;
+        }
+    }
+
+    void recordIN(uint8_t in)
+    {
+        if(_mode != Recording) return;
+
+        writeEvent(InEvent, &in, 1);
+    }
+
+    void recordUpload(const std::string& filepath)
+    {
+        if(_mode != Recording) return;
+
+        uint16_t length = uint16_t(std::min(filepath.size(), size_t(0xFFFF)));
+        std::vector<uint8_t> payload(2 + length);
+        payload[0] = uint8_t(LO_BYTE(length));
+        payload[1] = uint8_t(HI_BYTE(length));
+        memcpy(&payload[2], filepath.c_str(), length);
+        writeEvent(UploadEvent, &payload[0], int(payload.size()));
+    }
+}
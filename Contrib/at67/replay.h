@@ -0,0 +1,41 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <string>
+
+
+#define REPLAY_IDENTIFIER "GTREPL"
+#define REPLAY_VERSION    1
+
+
+// Deterministic record and replay of the calling thread's emulator instance; a recording is a snapshot of the machine it started
+// from followed by every IN change and emulator upload, stamped with the clock and edge, (vSync or hSync), that it happened on
+namespace Replay
+{
+    enum Mode {Off=0, Recording, Replaying};
+    enum Edge {VSyncEdge=0, HSyncEdge};
+    enum EventType {InEvent=0, UploadEvent, EndEvent};
+
+    struct ReplayHeader
+    {
+        char _name[7] = REPLAY_IDENTIFIER;
+        uint8_t _version = REPLAY_VERSION;
+        uint32_t _undefSeed = 0;
+        int64_t _startClock = 0;
+    };
+
+
+    Mode getMode(void);
+
+    bool startRecording(const std::string& filename, uint32_t undefSeed=0);
+    bool stopRecording(void);
+    bool startReplaying(const std::string& filename);
+    void stopReplaying(void);
+
+    void processEdge(Edge edge);
+    void recordIN(uint8_t in);
+    void recordUpload(const std::string& filepath);
+}
+
+#endif
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <vector>
+#include <deque>
+
+#include "memory.h"
+#include "cpu.h"
+#include "rewind.h"
+
+
+// Everything in the Machine block before RAM is stored as is in every record
+#define MACHINE_PREFIX_SIZE (offsetof(Cpu::Machine, _RAM))
+
+
+namespace Rewind
+{
+    struct Record
+    {
+        size_t _offset;
+        size_t _size;
+        int64_t _clock;
+        bool _keyframe;
+    };
+
+    bool _enabled = false;
+    int _framesSinceKeyframe = 0;
+
+    size_t _head = 0;
+    std::vector<uint8_t> _arena;
+    std::deque<Record> _records;
+
+    std::vector<uint8_t> _encoded;
+    uint8_t _prevRAM[RAM_SIZE_HI];
+    uint32_t _prevSizeRAM = 0;
+
+    Cpu::Snapshot* _snapshot = nullptr;
+
+
+    bool getEnabled(void) {return _enabled;}
+    int getNumFrames(void) {return int(_records.size());}
+
+    void setEnabled(bool enabled) {_enabled = enabled  &&  _arena.size();}
+
+
+    void initialise(void)
+    {
+        _snapshot = new (std::nothrow) Cpu::Snapshot;
+        if(!_snapshot)
+        {
+            fprintf(stderr, "Rewind::initialise() : out of memory!\n");
+            return;
+        }
+
+        _arena.resize(REWIND_ARENA_SIZE);
+        _encoded.reserve(MACHINE_PREFIX_SIZE + RAM_SIZE_HI*2);
+        _enabled = true;
+    }
+
+    void reset(void)
+    {
+        _head = 0;
+        _records.clear();
+        _framesSinceKeyframe = 0;
+    }
+
+    // Page is run length encoded in control bytes, bit 7 set is a run of (n & 0x7F)+1 zeroes, otherwise n+1 literal bytes follow
+    void encodePage(const uint8_t* xorPage)
+    {
+        int i = 0;
+        while(i < REWIND_PAGE_SIZE)
+        {
+            int run = 0;
+            while(i + run < REWIND_PAGE_SIZE  &&  run < 128  &&  xorPage[i + run] == 0) run++;
+            if(run)
+            {
+                _encoded.push_back(uint8_t(0x80 | (run - 1)));
+                i += run;
+                continue;
+            }
+
+            int len = 0;
+            while(i + len < REWIND_PAGE_SIZE  &&  len < 128  &&  xorPage[i + len] != 0) len++;
+            _encoded.push_back(uint8_t(len - 1));
+            _encoded.insert(_encoded.end(), &xorPage[i], &xorPage[i + len]);
+            i += len;
+        }
+    }
+
+    const uint8_t* decodePage(const uint8_t* data, uint8_t* page)
+    {
+        int i = 0;
+        while(i < REWIND_PAGE_SIZE)
+        {
+            uint8_t control = *data++;
+            int count = (control & 0x7F) + 1;
+            if(control & 0x80)
+            {
+                i += count;
+                continue;
+            }
+
+            for(int j=0; j<count; j++) page[i++] ^= *data++;
+        }
+
+        return data;
+    }
+
+    void storeRecord(bool keyframe, int64_t clock)
+    {
+        size_t size = _encoded.size();
+        if(size > _arena.size()) return;
+
+        if(_head + size > _arena.size())
+        {
+            // Everything between the head and the end of the arena is older than anything at the start, so it goes first
+            while(_records.size()  &&  _records.front()._offset >= _head) _records.pop_front();
+            _head = 0;
+        }
+
+        // Evict overwritten records, then any deltas that have lost their keyframe
+        while(_records.size()  &&  _records.front()._offset < _head + size  &&  _records.front()._offset + _records.front()._size > _head) _records.pop_front();
+        while(_records.size()  &&  !_records.front()._keyframe) _records.pop_front();
+
+        memcpy(&_arena[_head], &_encoded[0], size);
+        _records.push_back({_head, size, clock, keyframe});
+        _head += size;
+    }
+
+    // Called at every falling vSync edge of the interactive instance
+    void captureFrame(void)
+    {
+        if(!_enabled) return;
+
+        const Cpu::Machine& machine = Cpu::getEmulator()->_machine;
+        bool keyframe = _records.empty()  ||  machine._sizeRAM != _prevSizeRAM  ||  ++_framesSinceKeyframe >= REWIND_KEYFRAME_INTERVAL;
+
+        _encoded.clear();
+        _encoded.insert(_encoded.end(), (const uint8_t*)&machine, (const uint8_t*)&machine + MACHINE_PREFIX_SIZE);
+        if(keyframe)
+        {
+            _framesSinceKeyframe = 0;
+            _encoded.insert(_encoded.end(), machine._RAM, machine._RAM + machine._sizeRAM);
+        }
+        else
+        {
+            // Number of changed pages, then each page's number and it's encoded XOR with the previous frame
+            size_t countOffset = _encoded.size();
+            _encoded.push_back(0); _encoded.push_back(0);
+
+            uint16_t numPages = 0;
+            uint8_t xorPage[REWIND_PAGE_SIZE];
+            for(uint32_t page=0; page<machine._sizeRAM/REWIND_PAGE_SIZE; page++)
+            {
+                const uint8_t* curr = &machine._RAM[page*REWIND_PAGE_SIZE];
+                const uint8_t* prev = &_prevRAM[page*REWIND_PAGE_SIZE];
+                if(memcmp(curr, prev, REWIND_PAGE_SIZE) == 0) continue;
+
+                for(int i=0; i<REWIND_PAGE_SIZE; i++) xorPage[i] = curr[i] ^ prev[i];
+                _encoded.push_back(uint8_t(page));
+                encodePage(xorPage);
+                numPages++;
+            }
+
+            _encoded[countOffset + 0] = uint8_t(LO_BYTE(numPages));
+            _encoded[countOffset + 1] = uint8_t(HI_BYTE(numPages));
+        }
+
+        storeRecord(keyframe, machine._clock);
+
+        memcpy(_prevRAM, machine._RAM, machine._sizeRAM);
+        _prevSizeRAM = machine._sizeRAM;
+    }
+
+    // Rebuilds a frame from the nearest keyframe before it and restores it into the interactive instance, later frames are dropped
+    // so that the next capture is encoded against the restored RAM and lands after it in the arena
+    bool restoreFrame(int index)
+    {
+        if(!_snapshot  ||  index < 0  ||  index >= int(_records.size())) return false;
+
+        int keyframe = index;
+        while(keyframe > 0  &&  !_records[keyframe]._keyframe) keyframe--;
+        if(!_records[keyframe]._keyframe) return false;
+
+        Cpu::takeSnapshot(*_snapshot);
+        Cpu::Machine& machine = _snapshot->_machine;
+        for(int i=keyframe; i<=index; i++)
+        {
+            const uint8_t* data = &_arena[_records[i]._offset];
+            memcpy((uint8_t*)&machine, data, MACHINE_PREFIX_SIZE);
+            data += MACHINE_PREFIX_SIZE;
+
+            if(_records[i]._keyframe)
+            {
+                memcpy(machine._RAM, data, machine._sizeRAM);
+                continue;
+            }
+
+            uint16_t numPages = data[0] | (data[1] <<8);
+            data += 2;
+            for(int j=0; j<numPages; j++)
+            {
+                uint8_t page = *data++;
+                data = decodePage(data, &machine._RAM[page*REWIND_PAGE_SIZE]);
+            }
+        }
+
+        if(!Cpu::restoreSnapshot(*_snapshot)) return false;
+
+        _head = _records[index]._offset + _records[index]._size;
+        _records.erase(_records.begin() + index + 1, _records.end());
+        _framesSinceKeyframe = index - keyframe;
+
+        memcpy(_prevRAM, machine._RAM, machine._sizeRAM);
+        _prevSizeRAM = machine._sizeRAM;
+
+        return true;
+    }
+
+    // Goes back to the start of the current frame, or to the previous frame if the machine hasn't moved since the last capture
+    bool stepBack(void)
+    {
+        if(_records.empty()) return false;
+
+        int index = int(_records.size()) - 1;
+        if(Cpu::getClock() == _records.back()._clock)
+        {
+            if(index < 1) return false;
+            index--;
+        }
+
+        return restoreFrame(index);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdint.h>
+
+
+#define REWIND_ARENA_SIZE        (32<<20)
+#define REWIND_KEYFRAME_INTERVAL 60
+#define REWIND_PAGE_SIZE         256
+
+
+// Rolling history of the interactive emulator instance, one record per frame; keyframes hold all of RAM, every other frame holds
+// XOR/RLE deltas of just the RAM pages that changed since the previous frame, all records live in one fixed size arena
+namespace Rewind
+{
+    bool getEnabled(void);
+    int getNumFrames(void);
+
+    void setEnabled(bool enabled);
+
+    void initialise(void);
+    void reset(void);
+
+    void captureFrame(void);
+    bool restoreFrame(int index);
+    bool stepBack(void);
+}
+
+#endif
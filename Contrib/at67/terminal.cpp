@@ -178,8 +178,8 @@ namespace Terminal
             clipboardText[clipboardTextIndex++] = (i < int(_terminalTextSelected.size()) - 1) ? '\n' :  0;
         }
 
-        // Save to system clipboard
-        SDL_SetClipboardText(clipboardText);
+        // Save to system clipboard, (from the main thread)
+        Graphics::setClipboardText(clipboardText);
 
         delete [] clipboardText;
     }
@@ -595,15 +595,15 @@ namespace Terminal
 
         // Mouse button state
         Editor::MouseState mouseState;
-        mouseState._state = SDL_GetMouseState(&mouseState._x, &mouseState._y);
+        mouseState._state = Graphics::getMouseState(&mouseState._x, &mouseState._y);
 
         SDL_Event event;
-        while(SDL_PollEvent(&event))
+        while(Graphics::pollEvent(event))
         {
             SDL_Keycode keyCode = event.key.keysym.sym;
             Uint16 keyMod = event.key.keysym.mod & (KMOD_LCTRL | KMOD_LALT | KMOD_LSHIFT);
 
-            mouseState._state = SDL_GetMouseState(&mouseState._x, &mouseState._y);
+            mouseState._state = Graphics::getMouseState(&mouseState._x, &mouseState._y);
 
             handleGuiEvents(event);
 
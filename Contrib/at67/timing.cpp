@@ -1,6 +1,8 @@
 #include <algorithm>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <SDL.h>
 #include "timing.h"
@@ -13,30 +15,137 @@ namespace Timing
     double _frameTime = 0.0;
     double _timingAdjust = VSYNC_TIMING_60;
 
+    bool _turbo = false;
+    double _spinMargin = 0.002; // how far ahead of the deadline sleeping stops, follows how late the host wakes up from sleeps
+    double _hostRefresh = 1.0 / VSYNC_RATE;
+    double _emulationSpeed = 1.0;
+    uint64_t _presentCounter = 0;
+    uint64_t _updateCounter = 0;
+
+    bool _vSyncLock = false;
+    uint64_t _vSyncCount = 0;
+    std::mutex _vSyncMutex;
+    std::condition_variable _vSyncPresented;
+
 
     bool getFrameUpdate(void) {return _frameUpdate;}
     uint64_t getFrameCount(void) {return _frameCount;}
     double getFrameTime(void) {return _frameTime;}
     double getTimingHack(void) {return _timingAdjust;}
+    bool getTurbo(void) {return _turbo;}
+    double getEmulationSpeed(void) {return _emulationSpeed;}
 
     void setFrameUpdate(bool update) {_frameUpdate = update;}
     void setTimingHack(double hack) {_timingAdjust = hack;}
+    void setVSyncLock(bool vSyncLock) {_vSyncLock = vSyncLock;}
 
+    // Turbo presents no faster than the display the window is on can show
+    void setHostRefresh(int refreshRate) {_hostRefresh = (refreshRate > 0) ? 1.0 / refreshRate : 1.0 / VSYNC_RATE;}
 
-    void synchronise(void)
+    void setTurbo(bool turbo)
     {
-        static uint64_t prevFrameCounter = 0;
+        _presentCounter = _updateCounter = SDL_GetPerformanceCounter();
+        _emulationSpeed = 1.0;
+        _turbo = turbo;
+    }
+
+
+    bool skipFrame(void)
+    {
+        if(!_turbo) return false;
+
+        uint64_t counter = SDL_GetPerformanceCounter();
+        double frequency = double(SDL_GetPerformanceFrequency());
+        if(double(counter - _presentCounter) / frequency < _hostRefresh) return true;
+        _presentCounter = counter;
+
+        // Non critical render elements are only refreshed on presented frames
+        _frameUpdate = (double(counter - _updateCounter) / frequency >= NON_CRITICAL_TIMING);
+        if(_frameUpdate) _updateCounter = counter;
+
+        return false;
+    }
+
+    void pace(void)
+    {
+        static uint64_t deadline = 0;
+
+        double frequency = double(SDL_GetPerformanceFrequency());
+        uint64_t period = uint64_t(_timingAdjust * frequency);
+        uint64_t counter = SDL_GetPerformanceCounter();
+
+        // Deadlines are a fixed period apart so that late frames are caught up on, unless more than a frame has been lost, (debugging,
+        // loading, window dragging, etc)
+        deadline += period;
+        if(deadline + period < counter  ||  deadline > counter + period*2) deadline = counter + period;
+
+        for(;;)
+        {
+            double remaining = double(int64_t(deadline - counter)) / frequency;
+            if(remaining <= _spinMargin) break;
+
+            double request = remaining - _spinMargin;
+            std::this_thread::sleep_for(std::chrono::duration<double>(request));
+            uint64_t woken = SDL_GetPerformanceCounter();
+
+            // Margin jumps straight up to a late wake up and decays slowly back down, coarse host timers end up spinning the whole frame
+            double late = double(woken - counter) / frequency - request;
+            _spinMargin = std::max(late*1.5, _spinMargin*0.98 + late*0.02);
+            _spinMargin = std::min(std::max(_spinMargin, MIN_SPIN_TIMING), _timingAdjust);
+            counter = woken;
+        }
+
+        while(SDL_GetPerformanceCounter() < deadline);
+    }
+
+    void vSyncPresented(void)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_vSyncMutex);
+            _vSyncCount++;
+        }
+        _vSyncPresented.notify_one();
+    }
+
+    // The frame that was just published is presented at the display's next vsync, which releases the emulation; if nothing is presented
+    // within a couple of frames, (minimised, dragged, shutting down, etc), the timer paces the frame instead
+    void waitVSync(void)
+    {
+        static uint64_t vSyncCount = 0;
 
-        do
+        std::unique_lock<std::mutex> lock(_vSyncMutex);
+        if(!_vSyncPresented.wait_for(lock, std::chrono::duration<double>(_timingAdjust*2.0), [] {return _vSyncCount != vSyncCount;}))
         {
-            _frameTime = double(SDL_GetPerformanceCounter() - prevFrameCounter) / double(SDL_GetPerformanceFrequency());
+            lock.unlock();
+            pace();
+            return;
         }
-        while(_frameTime < _timingAdjust);
+
+        vSyncCount = _vSyncCount;
+    }
+
+    void synchronise(void)
+    {
+        static uint64_t prevFrameCounter = 0;
+        static uint64_t speedCounter = 0;
+        static uint64_t speedFrames = 0;
+
+        if(!_turbo) (_vSyncLock) ? waitVSync() : pace();
+        _frameTime = double(SDL_GetPerformanceCounter() - prevFrameCounter) / double(SDL_GetPerformanceFrequency());
         prevFrameCounter = SDL_GetPerformanceCounter();
 
         _frameCount++;
 
+        // Emulated frames per host second relative to real time, averaged over half a second
+        double speedTime = double(prevFrameCounter - speedCounter) / double(SDL_GetPerformanceFrequency());
+        if(speedTime >= 0.5)
+        {
+            _emulationSpeed = double(_frameCount - speedFrames) / (speedTime * VSYNC_RATE);
+            speedCounter = prevFrameCounter;
+            speedFrames = _frameCount;
+        }
+
         // Used for updating non critical render elements at a constant N times per second independently of the main windowed FPS
-        _frameUpdate = ((_frameCount % int((NON_CRITICAL_TIMING)/std::min(_frameTime, (NON_CRITICAL_TIMING)))) == 0);
+        if(!_turbo) _frameUpdate = ((_frameCount % int((NON_CRITICAL_TIMING)/std::min(_frameTime, (NON_CRITICAL_TIMING)))) == 0);
     }
 }
\ No newline at end of file
@@ -13,6 +13,7 @@
 #define HPIXELS_END         173
 #define VSYNC_TIMING_60     0.01667222407469 // 59.98Hz
 #define NON_CRITICAL_TIMING (VSYNC_TIMING_60*3.0)
+#define MIN_SPIN_TIMING     0.0002 // never sleep closer to the deadline than this
 
 #define CLOCK_FREQ   6250000
 #define CLOCK_RESET -2
@@ -30,10 +31,24 @@ namespace Timing
     uint64_t getFrameCount(void);
     double getFrameTime(void);
     double getTimingHack(void);
+    bool getTurbo(void);
+    double getEmulationSpeed(void);
 
     void setFrameUpdate(bool update);
     void setTimingHack(double hack);
+    void setTurbo(bool turbo);
+    void setVSyncLock(bool vSyncLock);
 
+    // Queried once by Graphics::initialise() on the main thread, which owns SDL's video calls
+    void setHostRefresh(int refreshRate);
+
+    // Called by the presenter after every present, with the vsync lock on the emulation thread waits for these instead of it's own timer
+    void vSyncPresented(void);
+
+    // Turbo runs unthrottled, a frame is only presented once per host display refresh, skipped frames still count
+    bool skipFrame(void);
+
+    // Sleeps for most of the frame and spins for the rest, unless the renderer's vsync is already pacing presents at the right rate
     void synchronise(void);
 }
 
@@ -76,7 +76,7 @@ int main(int argc, char* argv[])
     Cpu::enableWin32ConsoleSaveFile(false);
 #endif
 
-    if(!Compiler::compile(filename, output)) return 1;
+    if(!Compiler::compile(filename, output, Memory::getSizeRAM())) return 1;
     if(!Assembler::assemble(output, address)) return 1;
 
     // Create gt1 format
@@ -128,7 +128,7 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    Loader::printGt1Stats(gt1FileName, gt1File, true);
+    Loader::printGt1Stats(gt1FileName, gt1File, true, Memory::getSizeRAM());
 
     return 0;
 }
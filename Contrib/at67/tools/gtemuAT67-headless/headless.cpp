@@ -0,0 +1,663 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include "../../memory.h"
+#include "../../cpu.h"
+#include "../../audio.h"
+#include "../../editor.h"
+#include "../../loader.h"
+#include "../../replay.h"
+#include "../../profiler.h"
+#include "../../capture.h"
+#include "../../timing.h"
+#include "../../image.h"
+#include "../../graphics.h"
+#include "../../expression.h"
+#include "../../assembler.h"
+#include "../../compiler.h"
+#include "../../operators.h"
+#include "../../keywords.h"
+#include "../../optimiser.h"
+#include "../../validater.h"
+#include "../../linker.h"
+
+
+#define HEADLESS_MAJOR_VERSION "0.1"
+#define HEADLESS_MINOR_VERSION "0"
+#define HEADLESS_VERSION_STR "gtemuAT67-headless v" HEADLESS_MAJOR_VERSION "." HEADLESS_MINOR_VERSION
+
+#define DEFAULT_FRAMES 600
+
+
+// Headless replacements for the parts of Graphics and Editor that the emulation core calls, there is no window, no event loop and no
+// throttling, video is taken from the emulator instance's raw OUT bytes and input comes from an optional per thread script that is
+// applied at the start of each frame
+namespace Graphics
+{
+    uint32_t _colours[COLOUR_PALETTE];
+
+    bool _enableUploadBar = false;
+
+
+    int getWidth(void) {return GIGA_WIDTH;}
+    int getHeight(void) {return SCREEN_HEIGHT;}
+
+    uint32_t* getPixels(void) {return nullptr;}
+    uint32_t* getColours(void) {return _colours;}
+
+    bool getUploadBarEnabled(void) {return _enableUploadBar;}
+    void setUploadFilename(const std::string& uploadFilename) {UNREFERENCED_PARAM(uploadFilename);}
+    void enableUploadBar(bool enableUploadBar) {_enableUploadBar = enableUploadBar;}
+    void updateUploadBar(float uploadPercentage) {UNREFERENCED_PARAM(uploadPercentage);}
+
+    void initialise(void)
+    {
+        for(int i=0; i<COLOUR_PALETTE; i++)
+        {
+            uint8_t r = uint8_t(double((i & 0x03) >>0) / 3.0 * 255.0);
+            uint8_t g = uint8_t(double((i & 0x0C) >>2) / 3.0 * 255.0);
+            uint8_t b = uint8_t(double((i & 0x30) >>4) / 3.0 * 255.0);
+
+            _colours[i] = 0xFF000000 | (r <<16) | (g <<8) | b;
+        }
+    }
+
+    void resetVTable(void)
+    {
+        for(int i=0; i<GIGA_HEIGHT; i++)
+        {
+            Cpu::setRAM(uint16_t(GIGA_VTABLE + i*2), uint8_t((GIGA_VRAM >>8) + i));
+            Cpu::setRAM(uint16_t(GIGA_VTABLE + 1 + i*2), 0x00);
+        }
+    }
+
+    void refreshTimingPixel(const Cpu::State& S, int vgaX, int pixelY, uint32_t colour, bool debugging)
+    {
+        UNREFERENCED_PARAM(S);
+        UNREFERENCED_PARAM(vgaX);
+        UNREFERENCED_PARAM(pixelY);
+        UNREFERENCED_PARAM(colour);
+        UNREFERENCED_PARAM(debugging);
+    }
+
+    void refreshScanline(const uint8_t* line, int vgaY)
+    {
+        UNREFERENCED_PARAM(line);
+        UNREFERENCED_PARAM(vgaY);
+    }
+
+    void render(bool synchronise)
+    {
+        UNREFERENCED_PARAM(synchronise);
+    }
+
+    // Each Gigatron pixel is 4 VGA pixels wide, so the calling thread's emulator instance is written out at the monitor's 640x480
+    bool savePpmFile(const std::string& filename)
+    {
+        const Cpu::Emulator* emulator = Cpu::getEmulator();
+
+        std::ofstream outfile(filename, std::ios::binary | std::ios::out);
+        if(!outfile.is_open())
+        {
+            fprintf(stderr, "Graphics::savePpmFile() : failed to open '%s'\n", filename.c_str());
+            return false;
+        }
+
+        outfile << "P6\n" << SCREEN_WIDTH << " " << SCREEN_HEIGHT << "\n255\n";
+
+        std::vector<uint8_t> line(SCREEN_WIDTH*3);
+        for(int y=0; y<SCREEN_HEIGHT; y++)
+        {
+            for(int x=0; x<SCREEN_WIDTH; x++)
+            {
+                uint32_t colour = _colours[emulator->_video[y][x/4] & (COLOUR_PALETTE - 1)];
+                line[x*3 + 0] = uint8_t(colour >>16);
+                line[x*3 + 1] = uint8_t(colour >>8);
+                line[x*3 + 2] = uint8_t(colour >>0);
+            }
+            outfile.write((char *)&line[0], line.size());
+        }
+
+        if(outfile.bad() || outfile.fail())
+        {
+            fprintf(stderr, "Graphics::savePpmFile() : write error in '%s'\n", filename.c_str());
+            return false;
+        }
+
+        return true;
+    }
+}
+
+namespace Editor
+{
+    struct ScriptedInput
+    {
+        uint64_t _frame;
+        uint8_t _in;
+    };
+
+    // Per thread, each emulator instance in a batch run has it's own script and frame count
+    thread_local uint64_t _frameCount = 0;
+    thread_local int _scriptIndex = 0;
+    thread_local std::vector<ScriptedInput> _scriptedInputs;
+
+    uint16_t _loadBaseAddress = DEFAULT_START_ADDRESS;
+    uint16_t _cpuUsageAddressA = HEX_BASE_ADDRESS;
+    uint16_t _cpuUsageAddressB = HEX_BASE_ADDRESS + 0x0020;
+
+    // Only gprintfs are trapped, there is no interactive debugger
+    uint64_t _ntvTraps[0x10000 / 64];
+    uint64_t _vpcTraps[0x10000 / 64];
+
+
+    uint64_t getFrameCount(void) {return _frameCount;}
+
+    bool getStartMusic(void) {return false;}
+    bool getSingleStepEnabled(void) {return false;}
+    bool getSingleStepping(void) {return false;}
+    MemoryMode getMemoryMode(void) {return RAM;}
+    const uint64_t* getNtvTraps(void) {return _ntvTraps;}
+    const uint64_t* getVpcTraps(void) {return _vpcTraps;}
+    uint16_t getLoadBaseAddress(void) {return _loadBaseAddress;}
+    uint16_t getCpuUsageAddressA(void) {return _cpuUsageAddressA;}
+    uint16_t getCpuUsageAddressB(void) {return _cpuUsageAddressB;}
+    int getVpcBreakPointsSize(void) {return 0;}
+    std::string* getCurrentFileEntryName(void) {return nullptr;}
+    std::string getBrowserPath(bool removeSlash) {UNREFERENCED_PARAM(removeSlash); return std::string("");}
+
+    void addRomEntry(uint8_t type, std::string& name) {UNREFERENCED_PARAM(type); UNREFERENCED_PARAM(name);}
+    void setEditorMode(EditorMode editorMode) {UNREFERENCED_PARAM(editorMode);}
+    void setSingleStepAddress(uint16_t address) {UNREFERENCED_PARAM(address);}
+    void setLoadBaseAddress(uint16_t address) {_loadBaseAddress = address;}
+    void setCpuUsageAddressA(uint16_t address) {_cpuUsageAddressA = address;}
+    void setCpuUsageAddressB(uint16_t address) {_cpuUsageAddressB = address;}
+
+    void addVpcBreakPoint(uint16_t address) {UNREFERENCED_PARAM(address);}
+    void clearVpcBreakPoints(void) {}
+
+    void addGprintfTrap(uint16_t address) {_vpcTraps[address >> 6] |= 1ull << (address & 63);}
+    void clearGprintfTraps(void) {memset(_vpcTraps, 0, sizeof(_vpcTraps));}
+
+    void browseDirectory(void) {}
+    void startDebugger(void) {}
+
+    bool handleDebugger(bool vpcTrap)
+    {
+        if(vpcTrap) Assembler::printGprintfStrings(Cpu::getVPC());
+        return false;
+    }
+
+    void resetInputScript(void)
+    {
+        _frameCount = 0;
+        _scriptIndex = 0;
+        _scriptedInputs.clear();
+    }
+
+    // Format is one '<frame> <IN>' pair per line, IN is hex and active low, (0xFF is no buttons), '#' starts a comment
+    bool loadInputScript(const std::string& filename)
+    {
+        std::ifstream infile(filename);
+        if(!infile.is_open())
+        {
+            fprintf(stderr, "Editor::loadInputScript() : failed to open '%s'\n", filename.c_str());
+            return false;
+        }
+
+        std::string line;
+        int lineNumber = 0;
+        while(std::getline(infile, line))
+        {
+            lineNumber++;
+
+            size_t comment = line.find_first_of("#");
+            if(comment != std::string::npos) line = line.substr(0, comment);
+            if(line.find_first_not_of(" \t\r\n") == std::string::npos) continue;
+
+            std::istringstream iss(line);
+            uint64_t frame;
+            unsigned int in;
+            if(!(iss >> std::dec >> frame >> std::hex >> in)  ||  in > 0xFF)
+            {
+                fprintf(stderr, "Editor::loadInputScript() : syntax error in '%s' : on line %d\n", filename.c_str(), lineNumber);
+                return false;
+            }
+
+            if(_scriptedInputs.size()  &&  frame < _scriptedInputs.back()._frame)
+            {
+                fprintf(stderr, "Editor::loadInputScript() : frames must be in ascending order in '%s' : on line %d\n", filename.c_str(), lineNumber);
+                return false;
+            }
+
+            _scriptedInputs.push_back({frame, uint8_t(in)});
+        }
+
+        return true;
+    }
+
+    // Called at every falling vSync edge
+    void handleInput(void)
+    {
+        while(_scriptIndex < int(_scriptedInputs.size())  &&  _scriptedInputs[_scriptIndex]._frame <= _frameCount)
+        {
+            Cpu::setIN(_scriptedInputs[_scriptIndex++]._in);
+        }
+
+        _frameCount++;
+    }
+}
+
+
+bool saveRamFile(const std::string& filename)
+{
+    std::ofstream outfile(filename, std::ios::binary | std::ios::out);
+    if(!outfile.is_open())
+    {
+        fprintf(stderr, "saveRamFile() : failed to open '%s'\n", filename.c_str());
+        return false;
+    }
+
+    std::vector<uint8_t> ram(Cpu::getSizeRAM());
+    for(int i=0; i<int(ram.size()); i++) ram[i] = Cpu::getRAM(uint16_t(i));
+    outfile.write((char *)&ram[0], ram.size());
+    if(outfile.bad() || outfile.fail())
+    {
+        fprintf(stderr, "saveRamFile() : write error in '%s'\n", filename.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool loadRomFile(const std::string& filename)
+{
+    std::ifstream infile(filename, std::ios::binary | std::ios::in);
+    if(!infile.is_open())
+    {
+        fprintf(stderr, "loadRomFile() : failed to open '%s'\n", filename.c_str());
+        return false;
+    }
+
+    int romSize;
+    uint8_t* rom = Cpu::getPtrToROM(romSize);
+    infile.read((char *)rom, romSize);
+    if(infile.bad() || infile.fail())
+    {
+        fprintf(stderr, "loadRomFile() : failed to read '%s'\n", filename.c_str());
+        return false;
+    }
+
+    Cpu::hashRom();
+    Cpu::reset(true);
+
+    return true;
+}
+
+// Sets up the calling thread's emulator instance to upload the file once the ROM has booted
+void prepareUpload(const std::string& filename)
+{
+    std::string name = filename;
+    size_t slash = name.find_last_of("\\/");
+    std::string path = (slash != std::string::npos) ? name.substr(0, slash) : ".";
+    Expression::replaceText(path, "\\", "/");
+    name = (slash != std::string::npos) ? name.substr(slash + 1) : name;
+
+    Assembler::setIncludePath(path);
+    Loader::setFilePath(path + "/" + name);
+    Loader::setUploadTarget(Loader::Emulator);
+
+    // Choose memory model
+    if(name.find("64k") != std::string::npos  ||  name.find("64K") != std::string::npos)
+    {
+        Cpu::setSizeRAM(RAM_SIZE_HI);
+    }
+}
+
+struct Job
+{
+    std::string _name;
+    int64_t _frames = DEFAULT_FRAMES;
+    std::string _ppmName;
+    std::string _inputName;
+    uint32_t _seed = 1;
+
+    bool _success = false;
+    int64_t _clocks = 0;
+    float _vCpuUtilisation = 0.0f;
+};
+
+// Format is one '<filename> <frames> <optional ppm filename> <optional input script>' job per line, '#' starts a comment
+bool loadJobFile(const std::string& filename, std::vector<Job>& jobs)
+{
+    std::ifstream infile(filename);
+    if(!infile.is_open())
+    {
+        fprintf(stderr, "loadJobFile() : failed to open '%s'\n", filename.c_str());
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while(std::getline(infile, line))
+    {
+        lineNumber++;
+
+        size_t comment = line.find_first_of("#");
+        if(comment != std::string::npos) line = line.substr(0, comment);
+        if(line.find_first_not_of(" \t\r\n") == std::string::npos) continue;
+
+        Job job;
+        std::istringstream iss(line);
+        if(!(iss >> job._name >> job._frames)  ||  job._frames <= 0)
+        {
+            fprintf(stderr, "loadJobFile() : syntax error in '%s' : on line %d\n", filename.c_str(), lineNumber);
+            return false;
+        }
+        iss >> job._ppmName >> job._inputName;
+        if(job._ppmName == "-") job._ppmName = "";
+
+        jobs.push_back(job);
+    }
+
+    return true;
+}
+
+// Each job's power on state follows from the batch seed and the job's position in the file, (murmur3's finaliser), so a seeded
+// batch is reproducible whatever the number of threads and whichever thread picks up the job
+uint32_t jobSeed(uint32_t seed, int index)
+{
+    uint32_t hash = seed ^ (uint32_t(index + 1) * 0x9E3779B9u);
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+
+    return (hash) ? hash : 1;
+}
+
+// Runs a job on it's own emulator instance, on the calling thread, starting from a copy of the interactive instance's ROM, or from
+// a copy of it's entire machine when a snapshot has been restored into it
+void runJob(Job& job, const Cpu::Emulator& source, bool fromSnapshot)
+{
+    Cpu::Emulator* emulator = Cpu::createEmulator(source._romIndex, job._seed);
+    if(!emulator) return;
+
+    Cpu::setEmulator(emulator);
+    memcpy(emulator->_ROM, source._ROM, sizeof(emulator->_ROM));
+    emulator->_romHash = source._romHash;
+    if(fromSnapshot)
+    {
+        memcpy(&emulator->_machine, &source._machine, sizeof(Cpu::Machine));
+    }
+    else
+    {
+        Cpu::reset(true);
+    }
+
+    Editor::resetInputScript();
+    job._success = (job._inputName.empty()  ||  Editor::loadInputScript(job._inputName));
+    if(job._success)
+    {
+        prepareUpload(job._name);
+        while(int64_t(Editor::getFrameCount()) < job._frames) job._clocks += Cpu::runUntil(CLOCK_FREQ, Cpu::RunVSync);
+
+        job._vCpuUtilisation = Cpu::getvCpuUtilisation();
+        if(job._ppmName.size()  &&  !Graphics::savePpmFile(job._ppmName)) job._success = false;
+    }
+
+    Cpu::destroyEmulator(emulator);
+}
+
+// Jobs are handed out to a pool of threads, each running one independent emulator instance at a time
+bool runJobs(std::vector<Job>& jobs, int numThreads, uint32_t seed, bool fromSnapshot, bool stats)
+{
+    const Cpu::Emulator& source = *Cpu::getEmulator();
+    std::atomic<int> nextJob(0);
+
+    for(int i=0; i<int(jobs.size()); i++) jobs[i]._seed = jobSeed(seed, i);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(int i=0; i<std::min(numThreads, int(jobs.size())); i++)
+    {
+        threads.push_back(std::thread([&jobs, &nextJob, &source, fromSnapshot]()
+        {
+            for(int j=nextJob++; j<int(jobs.size()); j=nextJob++) runJob(jobs[j], source, fromSnapshot);
+        }));
+    }
+    for(int i=0; i<int(threads.size()); i++) threads[i].join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    bool success = true;
+    int64_t clocks = 0;
+    for(int i=0; i<int(jobs.size()); i++)
+    {
+        if(!jobs[i]._success) success = false;
+        clocks += jobs[i]._clocks;
+    }
+
+    if(stats)
+    {
+        double seconds = std::max(elapsed.count(), 1e-9);
+        fprintf(stderr, "\n**********************************************\n");
+        for(int i=0; i<int(jobs.size()); i++)
+        {
+            fprintf(stderr, "* %-24s : %s : %" PRId64 " frames : vCPU %0.1f%%\n", jobs[i]._name.c_str(), (jobs[i]._success) ? "ok" : "FAILED", jobs[i]._frames, jobs[i]._vCpuUtilisation * 100.0f);
+        }
+        fprintf(stderr, "**********************************************\n");
+        fprintf(stderr, "* Jobs             : %d\n", int(jobs.size()));
+        fprintf(stderr, "* Threads          : %d\n", int(threads.size()));
+        fprintf(stderr, "* Clocks           : %" PRId64 "\n", clocks);
+        fprintf(stderr, "* Host time        : %0.3f s\n", seconds);
+        fprintf(stderr, "* Speed            : %0.2f MHz : %0.2fx real time\n", double(clocks) / seconds / 1e6, double(clocks) / double(CLOCK_FREQ) / seconds);
+        fprintf(stderr, "**********************************************\n");
+    }
+
+    return success;
+}
+
+void usage(void)
+{
+    fprintf(stderr, "%s\n", HEADLESS_VERSION_STR);
+    fprintf(stderr, "Usage:   gtemuAT67-headless <options> <optional input filename>\n");
+    fprintf(stderr, "Options: -rom <filename>   : ROM to run, (default is the latest internal ROM)\n");
+    fprintf(stderr, "         -frames <n>       : number of frames to emulate, (default %d)\n", DEFAULT_FRAMES);
+    fprintf(stderr, "         -seconds <n>      : number of seconds of emulated time, (sets -frames)\n");
+    fprintf(stderr, "         -cycles <n>       : number of clocks to emulate, (overrides -frames)\n");
+    fprintf(stderr, "         -input <filename> : scripted input, one '<frame> <IN hex>' pair per line\n");
+    fprintf(stderr, "         -ram <filename>   : save final RAM\n");
+    fprintf(stderr, "         -loadstate <file> : start from a snapshot, (taken with the same ROM)\n");
+    fprintf(stderr, "         -savestate <file> : save a snapshot of the final machine state\n");
+    fprintf(stderr, "         -record <file>    : record the run's input and uploads for bit identical replays\n");
+    fprintf(stderr, "         -replay <file>    : replay a recording, (input scripts and uploads are ignored)\n");
+    fprintf(stderr, "         -vprofile <file>  : save a vCPU hotspot report, (CSV if the filename ends in .csv)\n");
+    fprintf(stderr, "         -vfolded <file>   : save vCPU hotspots as folded stacks for flame graphs\n");
+    fprintf(stderr, "         -nprofile <file>  : save a native per routine cycle report\n");
+    fprintf(stderr, "         -lst <file>       : ROM listing for native symbols, (default is ROMv*.lst for the ROM type)\n");
+    fprintf(stderr, "         -mix <file>       : save the native instruction mix as JSON\n");
+    fprintf(stderr, "         -mixfrom <frame>  : reset the instruction mix at a frame, (e.g. to skip booting)\n");
+    fprintf(stderr, "         -mixevery <n>     : also save the instruction mix every n frames, (<file>.<frame>)\n");
+    fprintf(stderr, "         -hle              : run vCPU instructions by high level emulation rather than the ROM's interpreter\n");
+    fprintf(stderr, "         -fastforward <n>  : high level emulation for the first n frames, then the ROM's interpreter\n");
+    fprintf(stderr, "         -seed <n>         : non zero seed for the power on state, (default is the time)\n");
+    fprintf(stderr, "         -ppm <filename>   : save final framebuffer as a 640x480 PPM image\n");
+    fprintf(stderr, "         -capture <file>   : capture every frame, (Y4M if it ends in .y4m, otherwise raw), and the audio to <file>.wav\n");
+    fprintf(stderr, "         -audio <file>     : render the audio to a 44.1kHz 16 bit WAV\n");
+    fprintf(stderr, "         -audiostats <file>: save each frame's audio peak and RMS as CSV, (needs -audio)\n");
+    fprintf(stderr, "         -synth            : synthesise the audio from the channel registers once a frame, (rather than XOUT)\n");
+    fprintf(stderr, "         -jobs <filename>  : batch of independent runs, one '<filename> <frames> <ppm> <input>' job per line\n");
+    fprintf(stderr, "         -threads <n>      : number of threads running jobs, (default is the number of cores)\n");
+    fprintf(stderr, "         -stats            : print timing stats\n");
+}
+
+int main(int argc, char* argv[])
+{
+    std::string romName, inputName, ramName, ppmName, jobsName, loadStateName, saveStateName, recordName, replayName, vProfileName, vFoldedName, nProfileName, lstName, mixName, captureName, audioName, audioStatsName, name;
+    uint32_t seed = 0;
+    int numThreads = std::max(int(std::thread::hardware_concurrency()), 1);
+    int64_t frames = DEFAULT_FRAMES;
+    int64_t cycles = 0;
+    int64_t mixFrom = 0, mixEvery = 0;
+    int64_t fastForward = 0;
+    bool hle = false;
+    bool synth = false;
+    bool stats = false;
+
+    for(int i=1; i<argc; i++)
+    {
+        std::string arg = std::string(argv[i]);
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "-rom"  &&  hasValue) romName = argv[++i];
+        else if(arg == "-frames"  &&  hasValue) frames = strtoll(argv[++i], nullptr, 10);
+        else if(arg == "-seconds"  &&  hasValue) frames = int64_t(strtod(argv[++i], nullptr) * CLOCK_FREQ / (SCAN_LINES*HLINE_END) + 0.5);
+        else if(arg == "-cycles"  &&  hasValue) cycles = strtoll(argv[++i], nullptr, 10);
+        else if(arg == "-input"  &&  hasValue) inputName = argv[++i];
+        else if(arg == "-ram"  &&  hasValue) ramName = argv[++i];
+        else if(arg == "-ppm"  &&  hasValue) ppmName = argv[++i];
+        else if(arg == "-capture"  &&  hasValue) captureName = argv[++i];
+        else if(arg == "-audio"  &&  hasValue) audioName = argv[++i];
+        else if(arg == "-audiostats"  &&  hasValue) audioStatsName = argv[++i];
+        else if(arg == "-synth") synth = true;
+        else if(arg == "-loadstate"  &&  hasValue) loadStateName = argv[++i];
+        else if(arg == "-savestate"  &&  hasValue) saveStateName = argv[++i];
+        else if(arg == "-record"  &&  hasValue) recordName = argv[++i];
+        else if(arg == "-replay"  &&  hasValue) replayName = argv[++i];
+        else if(arg == "-vprofile"  &&  hasValue) vProfileName = argv[++i];
+        else if(arg == "-vfolded"  &&  hasValue) vFoldedName = argv[++i];
+        else if(arg == "-nprofile"  &&  hasValue) nProfileName = argv[++i];
+        else if(arg == "-lst"  &&  hasValue) lstName = argv[++i];
+        else if(arg == "-mix"  &&  hasValue) mixName = argv[++i];
+        else if(arg == "-mixfrom"  &&  hasValue) mixFrom = strtoll(argv[++i], nullptr, 10);
+        else if(arg == "-mixevery"  &&  hasValue) mixEvery = strtoll(argv[++i], nullptr, 10);
+        else if(arg == "-fastforward"  &&  hasValue) fastForward = strtoll(argv[++i], nullptr, 10);
+        else if(arg == "-hle") hle = true;
+        else if(arg == "-seed"  &&  hasValue) seed = uint32_t(strtoul(argv[++i], nullptr, 0));
+        else if(arg == "-jobs"  &&  hasValue) jobsName = argv[++i];
+        else if(arg == "-threads"  &&  hasValue) numThreads = std::max(int(strtol(argv[++i], nullptr, 10)), 1);
+        else if(arg == "-stats") stats = true;
+        else if(arg[0] != '-'  &&  name.empty()) name = arg;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if((frames <= 0  &&  cycles <= 0)  ||  (audioStatsName.size()  &&  audioName.empty()))
+    {
+        usage();
+        return 1;
+    }
+
+    Memory::initialise();
+    Loader::initialise();
+    Cpu::initialise();
+    Audio::initialise();
+    Image::initialise();
+    Graphics::initialise();
+    Expression::initialise();
+    Assembler::initialise();
+    Compiler::initialise();
+    Operators::initialise();
+    Keywords::initialise();
+    Optimiser::initialise();
+    Validater::initialise();
+    Linker::initialise();
+
+    if(romName.size()  &&  !loadRomFile(romName)) return 1;
+    if(seed) Cpu::seedMachine(seed);
+    if(loadStateName.size()  &&  !Cpu::loadSnapshotFile(loadStateName)) return 1;
+
+    if(jobsName.size())
+    {
+        std::vector<Job> jobs;
+        bool success = loadJobFile(jobsName, jobs)  &&  runJobs(jobs, numThreads, (seed) ? seed : uint32_t(time(nullptr)), loadStateName.size() > 0, stats);
+        Cpu::shutdown();
+        return (success) ? 0 : 1;
+    }
+
+    if(inputName.size()  &&  !Editor::loadInputScript(inputName)) return 1;
+
+    // A replay restores the machine it was recorded from, a recording starts from the machine as it is now
+    if(replayName.size()  &&  !Replay::startReplaying(replayName)) return 1;
+    if(recordName.size()  &&  !Replay::startRecording(recordName, seed)) return 1;
+
+    if(vProfileName.size()  ||  vFoldedName.size()) Profiler::setVCpuEnabled(true);
+    if(lstName.size()  &&  !Profiler::loadNativeSymbols(lstName)) return 1;
+    if(nProfileName.size()) Profiler::setNativeEnabled(true);
+    if(mixName.size()) Profiler::setMixEnabled(true);
+    if(hle  ||  fastForward > 0) Cpu::setVCpuHle(true);
+    if(synth) Audio::setSynthesis(true);
+    if(audioName.size()) Audio::startRender();
+    if(captureName.size()  &&  !Capture::start(captureName, captureName.substr(0, captureName.find_last_of('.')) + ".wav")) return 1;
+
+    // Load file, it is uploaded by the emulation once the ROM has booted
+    if(name.size()) prepareUpload(name);
+
+    // Unthrottled
+    auto start = std::chrono::steady_clock::now();
+    int64_t clocks = 0;
+    if(cycles > 0)
+    {
+        clocks = Cpu::runUntil(cycles);
+    }
+    else
+    {
+        while(int64_t(Editor::getFrameCount()) < frames)
+        {
+            clocks += Cpu::runUntil(CLOCK_FREQ, Cpu::RunVSync);
+            if(!hle  &&  fastForward > 0  &&  int64_t(Editor::getFrameCount()) >= fastForward) Cpu::setVCpuHle(false);
+
+            if(mixName.size())
+            {
+                int64_t frame = int64_t(Editor::getFrameCount());
+                if(frame == mixFrom) Profiler::resetMix();
+                if(mixEvery > 0  &&  frame > mixFrom  &&  (frame - mixFrom) % mixEvery == 0) Profiler::saveMixJson(mixName + "." + std::to_string(frame));
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if(stats)
+    {
+        double emulated = double(clocks) / double(CLOCK_FREQ);
+        double seconds = std::max(elapsed.count(), 1e-9);
+        fprintf(stderr, "\n**********************************************\n");
+        fprintf(stderr, "* Frames           : %" PRIu64 "\n", Editor::getFrameCount());
+        fprintf(stderr, "* Clocks           : %" PRId64 "\n", clocks);
+        fprintf(stderr, "* Emulated time    : %0.3f s\n", emulated);
+        fprintf(stderr, "* Host time        : %0.3f s\n", seconds);
+        fprintf(stderr, "* Speed            : %0.2f MHz : %0.2fx real time\n", double(clocks) / seconds / 1e6, emulated / seconds);
+        fprintf(stderr, "* vCPU utilisation : %0.1f%%\n", Cpu::getvCpuUtilisation() * 100.0f);
+        fprintf(stderr, "**********************************************\n");
+    }
+
+    bool success = true;
+    if(captureName.size()  &&  !Capture::stop()) success = false;
+    if(audioName.size()  &&  !Audio::saveRender(audioName, audioStatsName)) success = false;
+    if(recordName.size()  &&  !Replay::stopRecording()) success = false;
+    if(ramName.size()  &&  !saveRamFile(ramName)) success = false;
+    if(vProfileName.size()  &&  !Profiler::saveVCpuReport(vProfileName)) success = false;
+    if(vFoldedName.size()  &&  !Profiler::saveVCpuFolded(vFoldedName)) success = false;
+    if(nProfileName.size()  &&  !Profiler::saveNativeReport(nProfileName)) success = false;
+    if(mixName.size()  &&  !Profiler::saveMixJson(mixName)) success = false;
+    if(ppmName.size()  &&  !Graphics::savePpmFile(ppmName)) success = false;
+    if(saveStateName.size()  &&  !Cpu::saveSnapshotFile(saveStateName)) success = false;
+
+    Cpu::shutdown();
+
+    return (success) ? 0 : 1;
+}